@@ -0,0 +1,248 @@
+// tcfg_client end to end over tcfg_wire_loopback: requests go in as SLIP bytes, through handle_rx_pkt dispatch and the
+// real handlers (host stand-ins for NVS, OTA and the data partition underneath), and replies come back out as SLIP bytes.
+// Each case checks its replies, so a failure here is a protocol regression, not just a slow run.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <esp_log.h>
+#include <mbedtls/sha256.h>
+#include "tcfg_client.hpp"
+#include "tcfg_slip.hpp"
+#include "tcfg_wire_loopback.hpp"
+
+namespace
+{
+    constexpr uint32_t REPLY_TIMEOUT_MS = 5000;
+
+    tcfg_wire_loopback wire;
+
+    void send_req(tcfg_client::pkt_type type, const void *payload, size_t len)
+    {
+        std::vector<uint8_t> frame(sizeof(tcfg_client::header) + len);
+        auto *hdr = (tcfg_client::header *)frame.data();
+        hdr->type = type;
+        hdr->len = len;
+        hdr->crc = 0;
+        if (len > 0) {
+            memcpy(frame.data() + sizeof(tcfg_client::header), payload, len);
+        }
+
+        hdr->crc = tcfg_slip::crc16_update(0, frame.data(), frame.size());
+        wire.host_send_frame(frame.data(), frame.size());
+    }
+
+    // Next reply, checked for type and length; the payload is left in reply_out
+    bool recv_reply(tcfg_client::pkt_type expect, std::vector<uint8_t> &reply_out)
+    {
+        std::vector<uint8_t> frame;
+        if (!wire.host_recv_frame(frame, REPLY_TIMEOUT_MS) || frame.size() < sizeof(tcfg_client::header)) {
+            printf("  no reply (expecting 0x%02x)\n", expect);
+            return false;
+        }
+
+        tcfg_client::header hdr = {};
+        memcpy(&hdr, frame.data(), sizeof(hdr));
+        if (hdr.type != expect || hdr.len != frame.size() - sizeof(hdr)) {
+            printf("  unexpected reply 0x%02x len %u (expecting 0x%02x)\n", hdr.type, hdr.len, expect);
+            return false;
+        }
+
+        reply_out.assign(frame.begin() + sizeof(hdr), frame.end());
+        return true;
+    }
+
+    double secs_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool bench_ping(size_t count)
+    {
+        std::vector<uint8_t> reply;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t idx = 0; idx < count; idx += 1) {
+            send_req(tcfg_client::PKT_PING, nullptr, 0);
+            if (!recv_reply(tcfg_client::PKT_ACK, reply)) {
+                return false;
+            }
+        }
+
+        printf("%-24s %8.2f us/round trip\n", "ping", secs_since(start) * 1e6 / count);
+        return true;
+    }
+
+    bool bench_config(size_t count)
+    {
+        std::vector<uint8_t> req(sizeof(tcfg_client::cfg_pkt) + sizeof(uint32_t));
+        auto *pkt = (tcfg_client::cfg_pkt *)req.data();
+        strcpy(pkt->ns, "bench");
+        strcpy(pkt->key, "counter");
+        pkt->type = NVS_TYPE_U32;
+
+        std::vector<uint8_t> reply;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t idx = 0; idx < count; idx += 1) {
+            pkt->val_len = sizeof(idx);
+            memcpy(pkt->value, &idx, sizeof(idx));
+            send_req(tcfg_client::PKT_SET_CONFIG, req.data(), req.size());
+            if (!recv_reply(tcfg_client::PKT_ACK, reply)) {
+                return false;
+            }
+
+            pkt->val_len = 0;
+            send_req(tcfg_client::PKT_GET_CONFIG, req.data(), sizeof(tcfg_client::cfg_pkt));
+            uint32_t got = UINT32_MAX;
+            if (!recv_reply(tcfg_client::PKT_CONFIG_RESULT, reply) || reply.size() != req.size()) {
+                return false;
+            }
+
+            memcpy(&got, reply.data() + sizeof(tcfg_client::cfg_pkt), sizeof(got));
+            if (got != idx) {
+                printf("  config readback mismatch: wrote %u, read %u\n", idx, got);
+                return false;
+            }
+        }
+
+        printf("%-24s %8.2f us/set+get\n", "config u32", secs_since(start) * 1e6 / count);
+        return true;
+    }
+
+    bool bench_upload(size_t file_len, size_t chunk_len)
+    {
+        std::vector<uint8_t> data(file_len);
+        std::mt19937 rng(file_len);
+        for (auto &byte : data) {
+            byte = rng();
+        }
+
+        uint8_t hash[32] = {};
+        mbedtls_sha256(data.data(), data.size(), hash, 0);
+
+        char path[UINT8_MAX] = {};
+        snprintf(path, sizeof(path), "%s/bench_%zu.bin", TCFG_DATA_PATH, file_len);
+
+        std::vector<uint8_t> begin(sizeof(tcfg_client::path_pkt) + sizeof(tcfg_client::file_write_opts));
+        auto *path_req = (tcfg_client::path_pkt *)begin.data();
+        auto *opts = (tcfg_client::file_write_opts *)(begin.data() + sizeof(tcfg_client::path_pkt));
+        path_req->len = file_len;
+        snprintf(path_req->path, sizeof(path_req->path), "%s", path);
+        memcpy(opts->hash, hash, sizeof(hash));
+
+        std::vector<uint8_t> reply;
+        auto start = std::chrono::steady_clock::now();
+        send_req(tcfg_client::PKT_BEGIN_FILE_WRITE, begin.data(), begin.size());
+        if (!recv_reply(tcfg_client::PKT_CHUNK_ACK, reply)) {
+            return false;
+        }
+
+        // Stop-and-wait: each chunk acked with the next offset, the last one with the hash of what was received
+        size_t offset = 0;
+        while (offset < file_len) {
+            size_t len = std::min(chunk_len, file_len - offset);
+            send_req(tcfg_client::PKT_FILE_CHUNK, data.data() + offset, len);
+            if (!recv_reply(tcfg_client::PKT_CHUNK_ACK, reply) || reply.empty()) {
+                return false;
+            }
+
+            offset += len;
+            auto state = (tcfg_client::chunk_state)reply[0];
+            if (state != (offset < file_len ? tcfg_client::CHUNK_XFER_NEXT : tcfg_client::CHUNK_XFER_DONE)) {
+                printf("  upload stopped at %zu with state %u\n", offset, state);
+                return false;
+            }
+        }
+
+        double secs = secs_since(start);
+        tcfg_client::path_pkt info_req = {};
+        info_req.len = strlen(path);
+        memcpy(info_req.path, path, info_req.len);
+        send_req(tcfg_client::PKT_GET_FILE_INFO, &info_req, sizeof(info_req));
+        if (!recv_reply(tcfg_client::PKT_FILE_INFO, reply) || reply.size() != sizeof(tcfg_client::file_info_pkt)) {
+            return false;
+        }
+
+        auto *info = (tcfg_client::file_info_pkt *)reply.data();
+        if (info->size != file_len || memcmp(info->hash, hash, sizeof(hash)) != 0) {
+            printf("  uploaded file doesn't match\n");
+            return false;
+        }
+
+        char name[32] = {};
+        snprintf(name, sizeof(name), "upload %zu KiB", file_len / 1024);
+        printf("%-24s %8.1f MB/s (%zu B chunks)\n", name, file_len / secs / 1e6, chunk_len);
+        return true;
+    }
+
+    bool bench_ota(size_t image_len, size_t chunk_len)
+    {
+        std::vector<uint8_t> image(image_len);
+        std::mt19937 rng(image_len);
+        for (auto &byte : image) {
+            byte = rng();
+        }
+
+        tcfg_client::ota_begin_opts opts = {};
+        std::vector<uint8_t> reply;
+        auto start = std::chrono::steady_clock::now();
+        send_req(tcfg_client::PKT_BEGIN_OTA, &opts, sizeof(opts));
+        if (!recv_reply(tcfg_client::PKT_ACK, reply)) {
+            return false;
+        }
+
+        for (size_t offset = 0; offset < image_len; offset += chunk_len) {
+            send_req(tcfg_client::PKT_OTA_CHUNK, image.data() + offset, std::min(chunk_len, image_len - offset));
+            if (!recv_reply(tcfg_client::PKT_CHUNK_ACK, reply) || reply.empty() || reply[0] != tcfg_client::CHUNK_XFER_NEXT) {
+                return false;
+            }
+        }
+
+        send_req(tcfg_client::PKT_OTA_COMMIT, nullptr, 0);
+        if (!recv_reply(tcfg_client::PKT_ACK, reply)) {
+            return false;
+        }
+
+        double secs = secs_since(start);
+
+        // The update slot is a plain file on the host
+        std::vector<uint8_t> written(image_len + 1);
+        FILE *fp = fopen(TCFG_HOST_FLASH_DIR "/ota_1.bin", "rb");
+        size_t read_len = fp != nullptr ? fread(written.data(), 1, written.size(), fp) : 0;
+        if (fp != nullptr) {
+            fclose(fp);
+        }
+
+        if (read_len != image_len || memcmp(written.data(), image.data(), image_len) != 0) {
+            printf("  OTA slot doesn't match the image\n");
+            return false;
+        }
+
+        char name[32] = {};
+        snprintf(name, sizeof(name), "ota %zu KiB", image_len / 1024);
+        printf("%-24s %8.1f MB/s (%zu B chunks)\n", name, image_len / secs / 1e6, chunk_len);
+        return true;
+    }
+}
+
+int main()
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    if (tcfg_client::instance()->init(&wire) != ESP_OK) {
+        printf("tcfg_client init failed, does %s exist?\n", TCFG_DATA_PATH);
+        return 1;
+    }
+
+    printf("== tcfg_client over loopback wire ==\n");
+    bool ok = bench_ping(20000);
+    ok = ok && bench_config(5000);
+    ok = ok && bench_upload(256 * 1024, 4000);
+    ok = ok && bench_upload(4 * 1024 * 1024, 4000);
+    ok = ok && bench_ota(2 * 1024 * 1024, 4000);
+
+    // Receive tasks are still blocked in the wire, skip static destructors rather than pull it out from under them
+    fflush(stdout);
+    std::_Exit(ok ? 0 : 1);
+}
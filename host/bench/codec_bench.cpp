@@ -0,0 +1,287 @@
+// Hot paths that bound link throughput, one JSON object per line on stdout so runs can be diffed or fed to a script:
+//   {"bench":"slip_decode","dist":"random","frame_bytes":512,"frames":N,"ns_per_frame":...,"bytes_per_s":...}
+//  - slip_decode: tcfg_slip::decode fed in CDC-sized blocks with attach/detach, as tcfg_wire_usb_cdc::serial_rx_cb does
+//  - slip_encode: START + tcfg_slip::encode + END into one staging block, as tcfg_wire_usb_cdc::write_response does
+//  - crc16: tcfg_client::get_crc16, i.e. ~esp_crc16_be(~init) over the frame
+//  - dispatch: request to reply through tcfg_client::handle_rx_pkt over tcfg_wire_loopback, so it includes the SLIP
+//    work on both ends and the handoff to the receive task; chunk cases go through the PKT_FILE_CHUNK handler
+// bytes_per_s counts decoded frame bytes (header + payload), not escaped wire bytes.
+// Usage: tcfg_codec_bench [min seconds per case, default 0.2]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+#include <esp_crc.h>
+#include <esp_log.h>
+#include "tcfg_client.hpp"
+#include "tcfg_slip.hpp"
+#include "tcfg_wire_loopback.hpp"
+
+namespace
+{
+    constexpr size_t MAX_PACKET_SIZE = TCFG_WIRE_MAX_PACKET_SIZE;
+    constexpr size_t RX_BLOCK_SIZE = 512; // CONFIG_TINYUSB_CDC_RX_BUFSIZE default
+    constexpr size_t FRAME_SIZES[] = { 16, 64, 256, 1024, MAX_PACKET_SIZE };
+    constexpr uint32_t REPLY_TIMEOUT_MS = 5000;
+
+    enum byte_dist : uint8_t {
+        DIST_RANDOM = 0,
+        DIST_TEXT = 1, // Printable ASCII, which still carries the odd 'Z' (SLIP_START) to escape
+        DIST_ESCAPE = 2, // Nothing but START/END/ESC, every byte doubles on the wire
+    };
+
+    const char *const DIST_NAMES[] = { "random", "text", "escape" };
+
+    double min_secs = 0.2;
+    tcfg_wire_loopback wire;
+
+    void fill(uint8_t *buf, size_t len, byte_dist dist, std::mt19937 &rng)
+    {
+        static const uint8_t specials[] = { tcfg_slip::SLIP_START, tcfg_slip::SLIP_END, tcfg_slip::SLIP_ESC };
+        for (size_t idx = 0; idx < len; idx += 1) {
+            switch (dist) {
+                case DIST_RANDOM: buf[idx] = (uint8_t)rng(); break;
+                case DIST_TEXT: buf[idx] = (uint8_t)(' ' + rng() % 95); break;
+                case DIST_ESCAPE: buf[idx] = specials[rng() % sizeof(specials)]; break;
+            }
+        }
+    }
+
+    // A request frame: tcfg_client::header with its CRC filled in, then len payload bytes of the given distribution
+    std::vector<uint8_t> make_frame(tcfg_client::pkt_type type, size_t len, byte_dist dist, std::mt19937 &rng)
+    {
+        std::vector<uint8_t> frame(sizeof(tcfg_client::header) + len);
+        fill(frame.data() + sizeof(tcfg_client::header), len, dist, rng);
+
+        auto *hdr = (tcfg_client::header *)frame.data();
+        hdr->type = type;
+        hdr->len = len;
+        hdr->crc = 0;
+        hdr->crc = tcfg_slip::crc16_update(0, frame.data(), frame.size());
+        return frame;
+    }
+
+    size_t encode_frame(const uint8_t *frame, size_t len, uint8_t *out, size_t cap)
+    {
+        size_t idx = 0;
+        out[idx++] = tcfg_slip::SLIP_START;
+        size_t consumed = 0;
+        idx += tcfg_slip::encode(frame, len, out + idx, cap - idx - 1, &consumed);
+        out[idx++] = tcfg_slip::SLIP_END;
+        return consumed == len ? idx : 0;
+    }
+
+    // Repeats batch (which handles batch_frames frames) until min_secs is up
+    void run_case(const char *bench, byte_dist dist, size_t frame_bytes, size_t batch_frames, const std::function<void()> &batch)
+    {
+        batch(); // Warm up
+
+        size_t frames = 0;
+        double secs = 0;
+        auto start = std::chrono::steady_clock::now();
+        do {
+            batch();
+            frames += batch_frames;
+            secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (secs < min_secs);
+
+        printf("{\"bench\":\"%s\",\"dist\":\"%s\",\"frame_bytes\":%zu,\"frames\":%zu,\"ns_per_frame\":%.1f,\"bytes_per_s\":%.0f}\n",
+               bench, DIST_NAMES[dist], frame_bytes, frames, secs * 1e9 / (double)frames, (double)(frame_bytes * frames) / secs);
+        fflush(stdout);
+    }
+
+    // A batch's worth of frames per case, so the clock is read rarely even for tiny frames
+    size_t batch_for(size_t frame_bytes)
+    {
+        return std::max<size_t>(1, (256 * 1024) / frame_bytes);
+    }
+
+    bool bench_decode(byte_dist dist, size_t frame_bytes)
+    {
+        std::mt19937 rng(frame_bytes);
+        size_t batch = batch_for(frame_bytes);
+        std::vector<uint8_t> stream;
+        std::vector<uint8_t> stage(MAX_PACKET_SIZE * 2 + 2);
+        for (size_t cnt = 0; cnt < batch; cnt += 1) {
+            auto frame = make_frame(tcfg_client::PKT_FILE_CHUNK, frame_bytes - sizeof(tcfg_client::header), dist, rng);
+            size_t len = encode_frame(frame.data(), frame.size(), stage.data(), stage.size());
+            stream.insert(stream.end(), stage.begin(), stage.begin() + len);
+        }
+
+        std::vector<uint8_t> buf(MAX_PACKET_SIZE);
+        size_t valid = 0;
+        size_t seen = 0;
+        run_case("slip_decode", dist, frame_bytes, batch, [&] {
+            tcfg_slip::decoder dec = {};
+            for (size_t off = 0; off < stream.size(); off += RX_BLOCK_SIZE) {
+                size_t blk_len = std::min(RX_BLOCK_SIZE, stream.size() - off);
+                size_t pos = 0;
+                while (pos < blk_len) {
+                    auto evt = tcfg_slip::DECODE_NEED_MORE;
+                    pos += tcfg_slip::decode(dec, stream.data() + off + pos, blk_len - pos, &evt);
+                    if (evt == tcfg_slip::DECODE_FRAME_START) {
+                        tcfg_slip::attach(dec, buf.data(), buf.size());
+                    } else if (evt == tcfg_slip::DECODE_FRAME_END) {
+                        uint16_t expect_crc = 0;
+                        memcpy(&expect_crc, buf.data() + tcfg_slip::FRAME_CRC_OFFSET, sizeof(expect_crc));
+                        valid += (dec.idx == frame_bytes && dec.crc == expect_crc) ? 1 : 0;
+                        seen += 1;
+                        tcfg_slip::detach(dec);
+                    }
+                }
+            }
+        });
+
+        if (valid != seen) {
+            fprintf(stderr, "slip_decode %s %zu: %zu of %zu frames bad\n", DIST_NAMES[dist], frame_bytes, seen - valid, seen);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool bench_encode(byte_dist dist, size_t frame_bytes)
+    {
+        std::mt19937 rng(frame_bytes);
+        auto frame = make_frame(tcfg_client::PKT_FILE_DATA, frame_bytes - sizeof(tcfg_client::header), dist, rng);
+        std::vector<uint8_t> stage(MAX_PACKET_SIZE * 2 + 2);
+
+        size_t written = 0;
+        run_case("slip_encode", dist, frame_bytes, batch_for(frame_bytes), [&] {
+            for (size_t cnt = batch_for(frame_bytes); cnt > 0; cnt -= 1) {
+                written = encode_frame(frame.data(), frame.size(), stage.data(), stage.size());
+                asm volatile("" : : "r"(stage.data()) : "memory");
+            }
+        });
+
+        if (written == 0) {
+            fprintf(stderr, "slip_encode %s %zu: frame didn't fit the staging block\n", DIST_NAMES[dist], frame_bytes);
+            return false;
+        }
+
+        return true;
+    }
+
+    void bench_crc16(byte_dist dist, size_t frame_bytes)
+    {
+        std::mt19937 rng(frame_bytes);
+        std::vector<uint8_t> frame(frame_bytes);
+        fill(frame.data(), frame.size(), dist, rng);
+
+        volatile uint16_t sink = 0;
+        run_case("crc16", dist, frame_bytes, batch_for(frame_bytes), [&] {
+            for (size_t cnt = batch_for(frame_bytes); cnt > 0; cnt -= 1) {
+                sink = ~esp_crc16_be((uint16_t)~0, frame.data(), frame.size());
+            }
+        });
+    }
+
+    bool recv_reply(tcfg_client::pkt_type expect, std::vector<uint8_t> &frame)
+    {
+        if (!wire.host_recv_frame(frame, REPLY_TIMEOUT_MS) || frame.size() < sizeof(tcfg_client::header)) {
+            fprintf(stderr, "  no reply (expecting 0x%02x)\n", expect);
+            return false;
+        }
+
+        if (frame[0] != expect) {
+            fprintf(stderr, "  unexpected reply 0x%02x (expecting 0x%02x)\n", frame[0], expect);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool bench_dispatch_ping()
+    {
+        std::mt19937 rng(0);
+        auto frame = make_frame(tcfg_client::PKT_PING, 0, DIST_RANDOM, rng);
+        std::vector<uint8_t> reply;
+        bool ok = true;
+        run_case("dispatch_ping", DIST_RANDOM, frame.size(), 1000, [&] {
+            for (size_t cnt = 0; cnt < 1000 && ok; cnt += 1) {
+                wire.host_send_frame(frame.data(), frame.size());
+                ok = recv_reply(tcfg_client::PKT_ACK, reply);
+            }
+        });
+
+        return ok;
+    }
+
+    // Stop-and-wait PKT_FILE_CHUNK frames of frame_bytes each; one upload per batch so the file stays bounded
+    bool bench_dispatch_chunk(byte_dist dist, size_t frame_bytes)
+    {
+        size_t chunk_len = frame_bytes - sizeof(tcfg_client::header);
+        size_t chunk_cnt = std::max<size_t>(16, (1024 * 1024) / frame_bytes);
+        std::mt19937 rng(frame_bytes);
+        std::vector<std::vector<uint8_t>> chunks;
+        for (size_t idx = 0; idx < 8; idx += 1) {
+            chunks.push_back(make_frame(tcfg_client::PKT_FILE_CHUNK, chunk_len, dist, rng));
+        }
+
+        tcfg_client::path_pkt begin = {};
+        snprintf(begin.path, sizeof(begin.path), "%s/codec_bench.bin", TCFG_DATA_PATH);
+        begin.len = chunk_len * chunk_cnt;
+        std::mt19937 hdr_rng(0);
+        auto begin_frame = make_frame(tcfg_client::PKT_BEGIN_FILE_WRITE, sizeof(begin), DIST_RANDOM, hdr_rng);
+        memcpy(begin_frame.data() + sizeof(tcfg_client::header), &begin, sizeof(begin));
+        auto *hdr = (tcfg_client::header *)begin_frame.data();
+        hdr->crc = 0;
+        hdr->crc = tcfg_slip::crc16_update(0, begin_frame.data(), begin_frame.size());
+
+        std::vector<uint8_t> reply;
+        bool ok = true;
+        run_case("dispatch_chunk", dist, frame_bytes, chunk_cnt, [&] {
+            wire.host_send_frame(begin_frame.data(), begin_frame.size());
+            ok = ok && recv_reply(tcfg_client::PKT_CHUNK_ACK, reply);
+            for (size_t idx = 0; idx < chunk_cnt && ok; idx += 1) {
+                auto &frame = chunks[idx % chunks.size()];
+                wire.host_send_frame(frame.data(), frame.size());
+                ok = recv_reply(tcfg_client::PKT_CHUNK_ACK, reply) && reply.size() > sizeof(tcfg_client::header);
+                auto state = ok ? (tcfg_client::chunk_state)reply[sizeof(tcfg_client::header)] : tcfg_client::CHUNK_ERR_INTERNAL;
+                ok = ok && state == (idx + 1 < chunk_cnt ? tcfg_client::CHUNK_XFER_NEXT : tcfg_client::CHUNK_XFER_DONE);
+            }
+        });
+
+        if (!ok) {
+            fprintf(stderr, "dispatch_chunk %s %zu: upload failed\n", DIST_NAMES[dist], frame_bytes);
+        }
+
+        return ok;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        min_secs = strtod(argv[1], nullptr);
+    }
+
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    if (tcfg_client::instance()->init(&wire) != ESP_OK) {
+        fprintf(stderr, "tcfg_client init failed, does %s exist?\n", TCFG_DATA_PATH);
+        return 1;
+    }
+
+    bool ok = true;
+    for (auto dist : { DIST_RANDOM, DIST_TEXT, DIST_ESCAPE }) {
+        for (auto frame_bytes : FRAME_SIZES) {
+            ok = bench_decode(dist, frame_bytes) && ok;
+            ok = bench_encode(dist, frame_bytes) && ok;
+            bench_crc16(dist, frame_bytes);
+        }
+    }
+
+    ok = ok && bench_dispatch_ping();
+    for (auto dist : { DIST_RANDOM, DIST_TEXT, DIST_ESCAPE }) {
+        for (auto frame_bytes : FRAME_SIZES) {
+            ok = ok && bench_dispatch_chunk(dist, frame_bytes);
+        }
+    }
+
+    // Receive tasks are still blocked in the wire, skip static destructors rather than pull it out from under them
+    fflush(stdout);
+    std::_Exit(ok ? 0 : 1);
+}
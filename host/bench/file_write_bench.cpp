@@ -0,0 +1,178 @@
+// File upload write path, before and after:
+//  - legacy: one fwrite() per chunk through newlib's default 128 byte stdio buffer, plus the three ftell() calls
+//    handle_file_chunk used to make per chunk
+//  - write-behind: chunks gathered into a sector-aligned buffer, written in whole blocks with stdio buffering off,
+//    file preallocated with ftruncate() up front
+// Writes that reach the "device" are counted through fopencookie(). Partial-sector writes are the ones that cost a
+// read-modify-write of a 4 KiB sector behind FATFS wear levelling. Host wall-clock numbers are only indicative.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t SECTOR_SIZE = 4096; // SPI_FLASH_SEC_SIZE
+    constexpr size_t WB_SIZE = 32768; // CONFIG_TC_FILE_WRITE_BUF_SIZE default
+    constexpr size_t NEWLIB_BUFSIZ = 128; // What ESP-IDF's newlib gives a FILE by default
+
+    struct device_file {
+        int fd = -1;
+        off_t pos = 0;
+        size_t writes = 0;
+        size_t partial_sector_writes = 0;
+    };
+
+    ssize_t dev_write(void *cookie, const char *buf, size_t len)
+    {
+        auto *dev = (device_file *)cookie;
+        dev->writes += 1;
+        if (dev->pos % SECTOR_SIZE != 0 || len % SECTOR_SIZE != 0) {
+            dev->partial_sector_writes += 1;
+        }
+
+        ssize_t ret = pwrite(dev->fd, buf, len, dev->pos);
+        if (ret > 0) {
+            dev->pos += ret;
+        }
+
+        return ret;
+    }
+
+    int dev_seek(void *cookie, off64_t *offset, int whence)
+    {
+        auto *dev = (device_file *)cookie;
+        off_t ret = lseek(dev->fd, whence == SEEK_CUR ? dev->pos + *offset : *offset, whence == SEEK_END ? SEEK_END : SEEK_SET);
+        if (ret < 0) {
+            return -1;
+        }
+
+        dev->pos = ret;
+        *offset = ret;
+        return 0;
+    }
+
+    int dev_close(void *cookie)
+    {
+        auto *dev = (device_file *)cookie;
+        fsync(dev->fd);
+        return close(dev->fd);
+    }
+
+    FILE *dev_open(const char *path, device_file &dev)
+    {
+        dev = {};
+        dev.fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (dev.fd < 0) {
+            return nullptr;
+        }
+
+        cookie_io_functions_t funcs = {};
+        funcs.write = dev_write;
+        funcs.seek = dev_seek;
+        funcs.close = dev_close;
+        return fopencookie(&dev, "w", funcs);
+    }
+
+    struct result {
+        double secs;
+        size_t writes;
+        size_t partial;
+    };
+
+    result run_legacy(const char *path, const std::vector<uint8_t> &data, size_t chunk_len)
+    {
+        device_file dev;
+        auto start = std::chrono::steady_clock::now();
+        FILE *fp = dev_open(path, dev);
+        char stdio_buf[NEWLIB_BUFSIZ]; // glibc ignores the size unless it's given the buffer too
+        setvbuf(fp, stdio_buf, _IOFBF, sizeof(stdio_buf));
+
+        volatile long sink = 0;
+        for (size_t off = 0; off < data.size(); off += chunk_len) {
+            size_t len = std::min(chunk_len, data.size() - off);
+            sink = sink + ftell(fp);
+            fwrite(data.data() + off, 1, len, fp);
+            sink = sink + ftell(fp);
+            sink = sink + ftell(fp);
+        }
+
+        fflush(fp);
+        size_t writes = dev.writes;
+        size_t partial = dev.partial_sector_writes;
+        fclose(fp);
+        return { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), writes, partial };
+    }
+
+    result run_write_behind(const char *path, const std::vector<uint8_t> &data, size_t chunk_len)
+    {
+        device_file dev;
+        auto start = std::chrono::steady_clock::now();
+        FILE *fp = dev_open(path, dev);
+        std::vector<uint8_t> wb(WB_SIZE);
+        size_t wb_len = 0;
+        setvbuf(fp, nullptr, _IONBF, 0);
+        if (ftruncate(dev.fd, data.size()) != 0) {
+            perror("ftruncate");
+        }
+
+        for (size_t off = 0; off < data.size(); off += chunk_len) {
+            const uint8_t *buf = data.data() + off;
+            size_t len = std::min(chunk_len, data.size() - off);
+            while (len > 0) {
+                size_t copy_len = std::min(len, WB_SIZE - wb_len);
+                memcpy(wb.data() + wb_len, buf, copy_len);
+                wb_len += copy_len;
+                buf += copy_len;
+                len -= copy_len;
+                if (wb_len == WB_SIZE) {
+                    fwrite(wb.data(), 1, wb_len, fp);
+                    wb_len = 0;
+                }
+            }
+        }
+
+        if (wb_len > 0) {
+            fwrite(wb.data(), 1, wb_len, fp);
+        }
+
+        fflush(fp);
+        size_t writes = dev.writes;
+        size_t partial = dev.partial_sector_writes;
+        fclose(fp);
+        return { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), writes, partial };
+    }
+
+    void bench_case(const char *path, size_t file_len, size_t chunk_len)
+    {
+        std::vector<uint8_t> data(file_len);
+        std::mt19937 rng(1234);
+        for (auto &b : data) {
+            b = rng();
+        }
+
+        auto legacy = run_legacy(path, data, chunk_len);
+        auto wb = run_write_behind(path, data, chunk_len);
+        double mb = file_len / 1e6;
+        printf("  %zu KiB in %zuB chunks\n", file_len / 1024, chunk_len);
+        printf("    legacy       %8.1f MB/s  %7zu writes  %7zu partial-sector\n", mb / legacy.secs, legacy.writes, legacy.partial);
+        printf("    write-behind %8.1f MB/s  %7zu writes  %7zu partial-sector\n", mb / wb.secs, wb.writes, wb.partial);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "tcfg_file_write_bench.bin";
+
+    printf("== file upload write path (%s) ==\n", path);
+    bench_case(path, 4 * 1024 * 1024, 4087); // Full PKT_FILE_CHUNK_AT frames
+    bench_case(path, 4 * 1024 * 1024, 1000);
+    bench_case(path, 1 * 1024 * 1024, 250);
+
+    unlink(path);
+    return 0;
+}
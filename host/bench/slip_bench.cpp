@@ -0,0 +1,338 @@
+// SLIP codec throughput, before and after:
+//  - decode: the old byte-at-a-time state machine from serial_rx_cb vs. tcfg_slip::decode
+//    (the latter also accumulates the frame CRC, which the old one left to handle_rx_pkt)
+//  - encode: the old one-write_queue-call-per-byte loop from write_response vs. tcfg_slip::encode into a staging block
+//  - frame validation: decode then a second CRC pass in handle_rx_pkt vs. the CRC accumulated by the decoder
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "tcfg_slip.hpp"
+
+namespace
+{
+    constexpr size_t MAX_PACKET_SIZE = 8192;
+    constexpr size_t RX_BLOCK_SIZE = 512; // CONFIG_TINYUSB_CDC_RX_BUFSIZE default
+    constexpr size_t TX_BLOCK_SIZE = 512; // CONFIG_TINYUSB_CDC_TX_BUFSIZE default
+
+    struct frame_sink {
+        std::vector<uint8_t> buf = std::vector<uint8_t>(MAX_PACKET_SIZE);
+        size_t frames = 0;
+        size_t bytes = 0;
+    };
+
+    // Reference: what serial_rx_cb did before, minus the per-byte tinyusb_cdcacm_read() and ESP_LOGD
+    struct legacy_decoder {
+        uint8_t *curr_decoded_buf = nullptr;
+        size_t decode_idx = 0;
+        bool slip_esc = false;
+
+        void feed(uint8_t next_byte, frame_sink &sink)
+        {
+            switch (next_byte) {
+                case tcfg_slip::SLIP_START: {
+                    curr_decoded_buf = sink.buf.data();
+                    decode_idx = 0;
+                    slip_esc = false;
+                    break;
+                }
+                case tcfg_slip::SLIP_END: {
+                    if (curr_decoded_buf != nullptr) {
+                        sink.frames += 1;
+                        sink.bytes += decode_idx;
+                        curr_decoded_buf = nullptr;
+                        decode_idx = 0;
+                    }
+                    slip_esc = false;
+                    break;
+                }
+                case tcfg_slip::SLIP_ESC: {
+                    if (curr_decoded_buf == nullptr) return;
+                    slip_esc = true;
+                    break;
+                }
+                case tcfg_slip::SLIP_ESC_END:
+                case tcfg_slip::SLIP_ESC_ESC:
+                case tcfg_slip::SLIP_ESC_START: {
+                    if (curr_decoded_buf == nullptr) return;
+                    if (slip_esc) {
+                        static const uint8_t unesc[] = { tcfg_slip::SLIP_END, tcfg_slip::SLIP_ESC, tcfg_slip::SLIP_START };
+                        curr_decoded_buf[decode_idx++] = unesc[next_byte - tcfg_slip::SLIP_ESC_END];
+                        slip_esc = false;
+                    } else {
+                        curr_decoded_buf[decode_idx++] = next_byte;
+                    }
+                    break;
+                }
+                default: {
+                    if (curr_decoded_buf == nullptr) return;
+                    curr_decoded_buf[decode_idx++] = next_byte;
+                    break;
+                }
+            }
+        }
+    };
+
+    void encode_frame(const uint8_t *buf, size_t len, std::vector<uint8_t> &out)
+    {
+        out.push_back(tcfg_slip::SLIP_START);
+        for (size_t idx = 0; idx < len; idx += 1) {
+            switch (buf[idx]) {
+                case tcfg_slip::SLIP_START: out.push_back(tcfg_slip::SLIP_ESC); out.push_back(tcfg_slip::SLIP_ESC_START); break;
+                case tcfg_slip::SLIP_END: out.push_back(tcfg_slip::SLIP_ESC); out.push_back(tcfg_slip::SLIP_ESC_END); break;
+                case tcfg_slip::SLIP_ESC: out.push_back(tcfg_slip::SLIP_ESC); out.push_back(tcfg_slip::SLIP_ESC_ESC); break;
+                default: out.push_back(buf[idx]); break;
+            }
+        }
+        out.push_back(tcfg_slip::SLIP_END);
+    }
+
+    std::vector<uint8_t> make_stream(size_t frame_len, size_t frame_cnt, bool all_special)
+    {
+        std::mt19937 rng(1234);
+        std::vector<uint8_t> frame(frame_len);
+        std::vector<uint8_t> stream;
+        for (size_t cnt = 0; cnt < frame_cnt; cnt += 1) {
+            for (auto &b : frame) {
+                b = all_special ? (uint8_t)tcfg_slip::SLIP_END : (uint8_t)rng();
+            }
+            encode_frame(frame.data(), frame.size(), stream);
+        }
+        return stream;
+    }
+
+    template<typename F>
+    double run_mbps(const std::vector<uint8_t> &stream, int rounds, F &&fn)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round += 1) {
+            fn();
+        }
+        auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return (double)stream.size() * rounds / secs / 1e6;
+    }
+
+    // Stand-in for tinyusb_cdcacm_write_queue(); kept out of line so each call costs what a call costs
+    struct fake_fifo {
+        std::vector<uint8_t> out;
+        size_t calls = 0;
+    };
+
+    __attribute__((noinline)) size_t fake_write_queue(fake_fifo &fifo, const uint8_t *buf, size_t len)
+    {
+        fifo.out.insert(fifo.out.end(), buf, buf + len);
+        fifo.calls += 1;
+        return len;
+    }
+
+    void legacy_encode(fake_fifo &fifo, const uint8_t *buf, size_t len)
+    {
+        const uint8_t slip_esc_end[] = { tcfg_slip::SLIP_ESC, tcfg_slip::SLIP_ESC_END };
+        const uint8_t slip_esc_esc[] = { tcfg_slip::SLIP_ESC, tcfg_slip::SLIP_ESC_ESC };
+        const uint8_t slip_esc_start[] = { tcfg_slip::SLIP_ESC, tcfg_slip::SLIP_ESC_START };
+        const uint8_t slip_start = tcfg_slip::SLIP_START;
+        const uint8_t slip_end = tcfg_slip::SLIP_END;
+
+        fake_write_queue(fifo, &slip_start, 1);
+        for (size_t idx = 0; idx < len; idx += 1) {
+            switch (buf[idx]) {
+                case tcfg_slip::SLIP_START: fake_write_queue(fifo, slip_esc_start, sizeof(slip_esc_start)); break;
+                case tcfg_slip::SLIP_END: fake_write_queue(fifo, slip_esc_end, sizeof(slip_esc_end)); break;
+                case tcfg_slip::SLIP_ESC: fake_write_queue(fifo, slip_esc_esc, sizeof(slip_esc_esc)); break;
+                default: fake_write_queue(fifo, &buf[idx], 1); break;
+            }
+        }
+        fake_write_queue(fifo, &slip_end, 1);
+    }
+
+    void staged_encode(fake_fifo &fifo, const uint8_t *buf, size_t len)
+    {
+        uint8_t tx_block[TX_BLOCK_SIZE];
+        size_t tx_idx = 0;
+        tx_block[tx_idx++] = tcfg_slip::SLIP_START;
+
+        size_t pos = 0;
+        while (pos < len) {
+            size_t consumed = 0;
+            tx_idx += tcfg_slip::encode(buf + pos, len - pos, tx_block + tx_idx, sizeof(tx_block) - tx_idx, &consumed);
+            pos += consumed;
+            if (pos < len) {
+                fake_write_queue(fifo, tx_block, tx_idx);
+                tx_idx = 0;
+            }
+        }
+
+        if (tx_idx == sizeof(tx_block)) {
+            fake_write_queue(fifo, tx_block, tx_idx);
+            tx_idx = 0;
+        }
+
+        tx_block[tx_idx++] = tcfg_slip::SLIP_END;
+        fake_write_queue(fifo, tx_block, tx_idx);
+    }
+
+    void bench_encode_case(const char *name, size_t frame_len, bool all_special)
+    {
+        constexpr int rounds = 2000;
+        std::mt19937 rng(4321);
+        std::vector<uint8_t> frame(frame_len);
+        for (auto &b : frame) {
+            b = all_special ? (uint8_t)tcfg_slip::SLIP_END : (uint8_t)rng();
+        }
+
+        fake_fifo legacy_fifo;
+        fake_fifo staged_fifo;
+        legacy_fifo.out.reserve(frame_len * 2 + 2);
+        staged_fifo.out.reserve(frame_len * 2 + 2);
+
+        legacy_encode(legacy_fifo, frame.data(), frame.size());
+        staged_encode(staged_fifo, frame.data(), frame.size());
+        if (legacy_fifo.out != staged_fifo.out) {
+            printf("%-24s MISMATCH: encoded output differs\n", name);
+            return;
+        }
+
+        size_t legacy_calls = legacy_fifo.calls;
+        size_t staged_calls = staged_fifo.calls;
+        double legacy_mbps = run_mbps(frame, rounds, [&] {
+            legacy_fifo.out.clear();
+            legacy_encode(legacy_fifo, frame.data(), frame.size());
+        });
+
+        double staged_mbps = run_mbps(frame, rounds, [&] {
+            staged_fifo.out.clear();
+            staged_encode(staged_fifo, frame.data(), frame.size());
+        });
+
+        printf("%-24s before %8.1f MB/s   after %8.1f MB/s   x%.1f   queue calls/frame %zu -> %zu\n",
+               name, legacy_mbps, staged_mbps, staged_mbps / legacy_mbps, legacy_calls, staged_calls);
+    }
+
+    // Decode a stream of valid frames and check each one's CRC, with or without the extra pass over the decoded buffer
+    double validate_ns_per_frame(const std::vector<uint8_t> &stream, size_t frame_cnt, bool second_pass, size_t *valid_out)
+    {
+        constexpr int rounds = 50;
+        std::vector<uint8_t> buf(MAX_PACKET_SIZE);
+        size_t valid = 0;
+
+        auto begin = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round += 1) {
+            tcfg_slip::decoder dec = {};
+            for (size_t off = 0; off < stream.size(); off += RX_BLOCK_SIZE) {
+                size_t blk_len = std::min(RX_BLOCK_SIZE, stream.size() - off);
+                size_t pos = 0;
+                while (pos < blk_len) {
+                    auto evt = tcfg_slip::DECODE_NEED_MORE;
+                    pos += tcfg_slip::decode(dec, stream.data() + off + pos, blk_len - pos, &evt);
+                    if (evt == tcfg_slip::DECODE_FRAME_START) {
+                        tcfg_slip::attach(dec, buf.data(), buf.size());
+                    } else if (evt == tcfg_slip::DECODE_FRAME_END) {
+                        uint16_t expect_crc = 0;
+                        memcpy(&expect_crc, buf.data() + tcfg_slip::FRAME_CRC_OFFSET, sizeof(expect_crc));
+                        uint16_t actual_crc = dec.crc;
+                        if (second_pass) {
+                            memset(buf.data() + tcfg_slip::FRAME_CRC_OFFSET, 0, tcfg_slip::FRAME_CRC_LEN);
+                            actual_crc = tcfg_slip::crc16_update(0, buf.data(), dec.idx);
+                        }
+
+                        valid += (actual_crc == expect_crc) ? 1 : 0;
+                        tcfg_slip::detach(dec);
+                    }
+                }
+            }
+        }
+
+        auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        *valid_out = valid / rounds;
+        return secs * 1e9 / (double)(frame_cnt * rounds);
+    }
+
+    void bench_validate_case(const char *name, size_t payload_len, size_t frame_cnt)
+    {
+        std::mt19937 rng(99);
+        std::vector<uint8_t> frame(5 + payload_len); // tcfg_client::header + payload
+        std::vector<uint8_t> stream;
+        for (size_t cnt = 0; cnt < frame_cnt; cnt += 1) {
+            for (auto &b : frame) {
+                b = (uint8_t)rng();
+            }
+
+            frame[0] = 0x21; // PKT_FILE_CHUNK
+            memset(frame.data() + tcfg_slip::FRAME_CRC_OFFSET, 0, tcfg_slip::FRAME_CRC_LEN);
+            memcpy(frame.data() + 3, &payload_len, 2);
+            uint16_t crc = tcfg_slip::crc16_update(0, frame.data(), frame.size());
+            memcpy(frame.data() + tcfg_slip::FRAME_CRC_OFFSET, &crc, sizeof(crc));
+            encode_frame(frame.data(), frame.size(), stream);
+        }
+
+        size_t before_valid = 0;
+        size_t after_valid = 0;
+        double before_ns = validate_ns_per_frame(stream, frame_cnt, true, &before_valid);
+        double after_ns = validate_ns_per_frame(stream, frame_cnt, false, &after_valid);
+        if (before_valid != frame_cnt || after_valid != frame_cnt) {
+            printf("%-24s MISMATCH: %zu / %zu of %zu frames valid\n", name, before_valid, after_valid, frame_cnt);
+            return;
+        }
+
+        printf("%-24s before %8.0f ns/frame   after %8.0f ns/frame   x%.2f\n", name, before_ns, after_ns, before_ns / after_ns);
+    }
+
+    void bench_decode_case(const char *name, const std::vector<uint8_t> &stream, size_t expect_frames)
+    {
+        constexpr int rounds = 50;
+        frame_sink legacy_sink;
+        double legacy_mbps = run_mbps(stream, rounds, [&] {
+            legacy_decoder dec;
+            for (auto b : stream) {
+                dec.feed(b, legacy_sink);
+            }
+        });
+
+        frame_sink block_sink;
+        double block_mbps = run_mbps(stream, rounds, [&] {
+            tcfg_slip::decoder dec = {};
+            for (size_t off = 0; off < stream.size(); off += RX_BLOCK_SIZE) {
+                size_t blk_len = std::min(RX_BLOCK_SIZE, stream.size() - off);
+                size_t pos = 0;
+                while (pos < blk_len) {
+                    auto evt = tcfg_slip::DECODE_NEED_MORE;
+                    pos += tcfg_slip::decode(dec, stream.data() + off + pos, blk_len - pos, &evt);
+                    if (evt == tcfg_slip::DECODE_FRAME_START) {
+                        tcfg_slip::attach(dec, block_sink.buf.data(), block_sink.buf.size());
+                    } else if (evt == tcfg_slip::DECODE_FRAME_END) {
+                        block_sink.frames += 1;
+                        block_sink.bytes += dec.idx;
+                        tcfg_slip::detach(dec);
+                    }
+                }
+            }
+        });
+
+        if (legacy_sink.frames != expect_frames * rounds || block_sink.frames != legacy_sink.frames || block_sink.bytes != legacy_sink.bytes) {
+            printf("%-24s MISMATCH: legacy %zu/%zu, block %zu/%zu\n", name, legacy_sink.frames, legacy_sink.bytes, block_sink.frames, block_sink.bytes);
+            return;
+        }
+
+        printf("%-24s before %8.1f MB/s   after %8.1f MB/s   x%.1f\n", name, legacy_mbps, block_mbps, block_mbps / legacy_mbps);
+    }
+}
+
+int main()
+{
+    printf("== decode ==\n");
+    bench_decode_case("random 4096B frames", make_stream(4096, 256, false), 256);
+    bench_decode_case("random 64B frames", make_stream(64, 8192, false), 8192);
+    bench_decode_case("all-0xc0 2048B frames", make_stream(2048, 256, true), 256);
+
+    printf("== encode ==\n");
+    bench_encode_case("random 4096B frame", 4096, false);
+    bench_encode_case("random 64B frame", 64, false);
+    bench_encode_case("all-0xc0 4096B frame", 4096, true);
+
+    printf("== decode + frame validation ==\n");
+    bench_validate_case("4096B payload", 4096, 256);
+    bench_validate_case("8187B payload", 8187, 128);
+    bench_validate_case("16B payload", 16, 8192);
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_crc.h>
+#include <esp_heap_caps.h>
+#include <esp_mac.h>
+#include <esp_flash.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <esp_app_desc.h>
+#include "tcfg_slip.hpp"
+
+esp_flash_t *esp_flash_default_chip = nullptr;
+
+namespace
+{
+    const auto boot_time = std::chrono::steady_clock::now();
+    esp_log_level_t log_level = ESP_LOG_WARN;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH: return "ESP_ERR_NVS_TYPE_MISMATCH";
+        case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_KEY_TOO_LONG: return "ESP_ERR_NVS_KEY_TOO_LONG";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_OTA_PARTITION_CONFLICT: return "ESP_ERR_OTA_PARTITION_CONFLICT";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    if (tag != nullptr && strcmp(tag, "*") == 0) {
+        log_level = level;
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    (void)tag;
+    if (level > log_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+uint16_t esp_crc16_be(uint16_t crc, const uint8_t *buf, uint32_t len)
+{
+    return ~tcfg_slip::crc16_update((uint16_t)~crc, buf, len);
+}
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    return crc32(crc, buf, len);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return calloc(n, size);
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return realloc(ptr, size);
+}
+
+void *heap_caps_malloc_prefer(size_t size, size_t num, ...)
+{
+    (void)num;
+    return malloc(size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac)
+{
+    static const uint8_t host_mac[6] = { 0x02, 0x00, 0x74, 0x63, 0x66, 0x67 };
+    memcpy(mac, host_mac, sizeof(host_mac));
+    return ESP_OK;
+}
+
+esp_err_t esp_flash_read_unique_chip_id(esp_flash_t *chip, uint64_t *out_id)
+{
+    (void)chip;
+    *out_id = 0x74636667686f7374ULL; // "tcfghost"
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot_time).count();
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+    return ESP_RST_POWERON;
+}
+
+void esp_restart()
+{
+    fprintf(stderr, "esp_restart() on host, exiting\n");
+    fflush(stderr);
+    std::_Exit(0);
+}
+
+const esp_app_desc_t *esp_app_get_description()
+{
+    static esp_app_desc_t desc = [] {
+        esp_app_desc_t out = {};
+        out.magic_word = ESP_APP_DESC_MAGIC_WORD;
+        snprintf(out.version, sizeof(out.version), "%s", "host");
+        snprintf(out.project_name, sizeof(out.project_name), "%s", "tcfg_host");
+        snprintf(out.time, sizeof(out.time), "%s", __TIME__);
+        snprintf(out.date, sizeof(out.date), "%s", __DATE__);
+        snprintf(out.idf_ver, sizeof(out.idf_ver), "%s", "host");
+        return out;
+    }();
+
+    return &desc;
+}
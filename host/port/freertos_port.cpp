@@ -0,0 +1,230 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/event_groups.h>
+
+struct tcfg_host_task {
+    std::string name;
+};
+
+struct tcfg_host_queue {
+    std::mutex lock;
+    std::condition_variable can_recv;
+    std::condition_variable can_send;
+    std::deque<std::vector<uint8_t>> items;
+    size_t depth = 0;
+    size_t item_size = 0;
+};
+
+struct tcfg_host_mutex {
+    std::timed_mutex lock;
+};
+
+struct tcfg_host_evt_group {
+    std::mutex lock;
+    std::condition_variable changed;
+    EventBits_t bits = 0;
+};
+
+namespace
+{
+    const auto boot_time = std::chrono::steady_clock::now();
+    thread_local TaskHandle_t curr_task = nullptr;
+
+    template<typename Pred>
+    bool wait_for(std::condition_variable &cv, std::unique_lock<std::mutex> &lk, TickType_t ticks, Pred pred)
+    {
+        if (ticks == portMAX_DELAY) {
+            cv.wait(lk, pred);
+            return true;
+        }
+
+        return cv.wait_for(lk, std::chrono::milliseconds(ticks), pred);
+    }
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t prio, TaskHandle_t *handle_out)
+{
+    (void)stack_depth;
+    (void)prio;
+    auto *task = new tcfg_host_task { name == nullptr ? "" : name };
+    if (handle_out != nullptr) {
+        *handle_out = task;
+    }
+
+    std::thread([fn, arg, task]() {
+        curr_task = task;
+        fn(arg);
+    }).detach();
+
+    return pdPASS;
+}
+
+BaseType_t xTaskCreateWithCaps(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t prio, TaskHandle_t *handle_out, uint32_t caps)
+{
+    (void)caps;
+    return xTaskCreate(fn, name, stack_depth, arg, prio, handle_out);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - boot_time).count();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return curr_task;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t depth, UBaseType_t item_size)
+{
+    if (depth == 0 || item_size == 0) {
+        return nullptr;
+    }
+
+    auto *queue = new tcfg_host_queue;
+    queue->depth = depth;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait_ticks)
+{
+    std::unique_lock<std::mutex> lk(queue->lock);
+    if (!wait_for(queue->can_send, lk, wait_ticks, [queue]() { return queue->items.size() < queue->depth; })) {
+        return pdFALSE;
+    }
+
+    auto *src = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(src, src + queue->item_size);
+    queue->can_recv.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t wait_ticks)
+{
+    return xQueueSend(queue, item, wait_ticks);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item_out, TickType_t wait_ticks)
+{
+    std::unique_lock<std::mutex> lk(queue->lock);
+    if (!wait_for(queue->can_recv, lk, wait_ticks, [queue]() { return !queue->items.empty(); })) {
+        return pdFALSE;
+    }
+
+    memcpy(item_out, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    queue->can_send.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lk(queue->lock);
+    queue->items.clear();
+    queue->can_send.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lk(queue->lock);
+    return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lk(queue->lock);
+    return queue->depth - queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new tcfg_host_mutex;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    delete sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait_ticks)
+{
+    if (wait_ticks == portMAX_DELAY) {
+        sem->lock.lock();
+        return pdTRUE;
+    }
+
+    return sem->lock.try_lock_for(std::chrono::milliseconds(wait_ticks)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    sem->lock.unlock();
+    return pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreate()
+{
+    return new tcfg_host_evt_group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    std::lock_guard<std::mutex> lk(group->lock);
+    group->bits |= bits;
+    group->changed.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    std::lock_guard<std::mutex> lk(group->lock);
+    EventBits_t prev = group->bits;
+    group->bits &= ~bits;
+    return prev;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    std::lock_guard<std::mutex> lk(group->lock);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t wait_ticks)
+{
+    std::unique_lock<std::mutex> lk(group->lock);
+    auto satisfied = [&]() { return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0; };
+    bool met = wait_for(group->changed, lk, wait_ticks, satisfied);
+    EventBits_t out = group->bits;
+    if (met && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+
+    return out;
+}
@@ -0,0 +1,293 @@
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <nvs_handle.hpp>
+
+namespace
+{
+    struct item {
+        nvs::ItemType type;
+        std::vector<uint8_t> data; // Strings include their terminator
+    };
+
+    using ns_map = std::map<std::string, item>;
+
+    std::mutex store_lock;
+    std::map<std::string, ns_map> store;
+
+    bool is_blob(nvs::ItemType type)
+    {
+        return type == nvs::ItemType::BLOB || type == nvs::ItemType::BLOB_DATA;
+    }
+
+    bool name_ok(const char *name)
+    {
+        return name != nullptr && name[0] != '\0' && strnlen(name, NVS_KEY_NAME_MAX_SIZE) < NVS_KEY_NAME_MAX_SIZE;
+    }
+
+    class host_nvs_handle : public nvs::NVSHandle
+    {
+    public:
+        host_nvs_handle(const char *_ns, bool _read_only) : ns(_ns), read_only(_read_only) {}
+
+        esp_err_t set_typed_item(nvs::ItemType datatype, const char *key, const void *data, size_t data_size) override
+        {
+            return put(datatype, key, data, data_size);
+        }
+
+        esp_err_t get_typed_item(nvs::ItemType datatype, const char *key, void *value, size_t data_size) override
+        {
+            std::lock_guard<std::mutex> lk(store_lock);
+            auto *found = find(datatype, key);
+            if (found == nullptr) {
+                return ESP_ERR_NVS_NOT_FOUND;
+            }
+
+            if (found->data.size() != data_size) {
+                return ESP_ERR_NVS_INVALID_LENGTH;
+            }
+
+            memcpy(value, found->data.data(), data_size);
+            return ESP_OK;
+        }
+
+        esp_err_t set_string(const char *key, const char *str) override
+        {
+            return str == nullptr ? ESP_ERR_INVALID_ARG : put(nvs::ItemType::SZ, key, str, strlen(str) + 1);
+        }
+
+        esp_err_t get_string(const char *key, char *out_str, size_t len) override
+        {
+            return get_var(nvs::ItemType::SZ, key, out_str, len);
+        }
+
+        esp_err_t set_blob(const char *key, const void *blob, size_t len) override
+        {
+            return put(nvs::ItemType::BLOB_DATA, key, blob, len);
+        }
+
+        esp_err_t get_blob(const char *key, void *blob, size_t len) override
+        {
+            return get_var(nvs::ItemType::BLOB_DATA, key, blob, len);
+        }
+
+        esp_err_t get_item_size(nvs::ItemType datatype, const char *key, size_t &size) override
+        {
+            std::lock_guard<std::mutex> lk(store_lock);
+            auto *found = find(datatype, key);
+            if (found == nullptr) {
+                return ESP_ERR_NVS_NOT_FOUND;
+            }
+
+            size = found->data.size();
+            return ESP_OK;
+        }
+
+        esp_err_t erase_item(const char *key) override
+        {
+            if (read_only) {
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            std::lock_guard<std::mutex> lk(store_lock);
+            return store[ns].erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        esp_err_t erase_all() override
+        {
+            if (read_only) {
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            std::lock_guard<std::mutex> lk(store_lock);
+            store[ns].clear();
+            return ESP_OK;
+        }
+
+        esp_err_t commit() override
+        {
+            return ESP_OK;
+        }
+
+    private:
+        // Caller holds store_lock
+        item *find(nvs::ItemType datatype, const char *key)
+        {
+            if (key == nullptr) {
+                return nullptr;
+            }
+
+            auto &keys = store[ns];
+            auto it = keys.find(key);
+            if (it == keys.end()) {
+                return nullptr;
+            }
+
+            bool type_ok = datatype == nvs::ItemType::ANY || it->second.type == datatype || (is_blob(datatype) && is_blob(it->second.type));
+            return type_ok ? &it->second : nullptr;
+        }
+
+        esp_err_t put(nvs::ItemType datatype, const char *key, const void *data, size_t data_size)
+        {
+            if (read_only) {
+                return ESP_ERR_NVS_INVALID_HANDLE;
+            }
+
+            if (!name_ok(key)) {
+                return ESP_ERR_NVS_KEY_TOO_LONG;
+            }
+
+            auto *src = static_cast<const uint8_t *>(data);
+            std::lock_guard<std::mutex> lk(store_lock);
+            store[ns][key] = item { datatype, std::vector<uint8_t>(src, src + data_size) };
+            return ESP_OK;
+        }
+
+        esp_err_t get_var(nvs::ItemType datatype, const char *key, void *out, size_t len)
+        {
+            std::lock_guard<std::mutex> lk(store_lock);
+            auto *found = find(datatype, key);
+            if (found == nullptr) {
+                return ESP_ERR_NVS_NOT_FOUND;
+            }
+
+            if (len < found->data.size()) {
+                return ESP_ERR_NVS_INVALID_LENGTH;
+            }
+
+            memcpy(out, found->data.data(), found->data.size());
+            return ESP_OK;
+        }
+
+    private:
+        std::string ns;
+        bool read_only;
+    };
+}
+
+struct nvs_opaque_iterator_t {
+    std::vector<nvs_entry_info_t> entries;
+    size_t pos = 0;
+};
+
+esp_err_t nvs_flash_init()
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *ns_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (!name_ok(ns_name) || out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lk(store_lock);
+    if (open_mode == NVS_READONLY && store.find(ns_name) == store.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    store[ns_name];
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+std::unique_ptr<nvs::NVSHandle> nvs::open_nvs_handle(const char *ns_name, nvs_open_mode_t open_mode, esp_err_t *err)
+{
+    nvs_handle_t probe = 0;
+    auto ret = nvs_open(ns_name, open_mode, &probe);
+    if (err != nullptr) {
+        *err = ret;
+    }
+
+    if (ret != ESP_OK) {
+        return nullptr;
+    }
+
+    return std::unique_ptr<nvs::NVSHandle>(new host_nvs_handle(ns_name, open_mode == NVS_READONLY));
+}
+
+esp_err_t nvs_entry_find(const char *part_name, const char *ns_name, nvs_type_t type, nvs_iterator_t *output_iterator)
+{
+    if (output_iterator == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *output_iterator = nullptr;
+    if (part_name == nullptr || strcmp(part_name, NVS_DEFAULT_PART_NAME) != 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    // Snapshot up front, so writes while iterating don't invalidate anything
+    auto *it = new nvs_opaque_iterator_t;
+    {
+        std::lock_guard<std::mutex> lk(store_lock);
+        for (const auto &ns : store) {
+            if (ns_name != nullptr && ns.first != ns_name) {
+                continue;
+            }
+
+            for (const auto &key : ns.second) {
+                auto item_type = (nvs_type_t)key.second.type;
+                if (type != NVS_TYPE_ANY && type != item_type) {
+                    continue;
+                }
+
+                nvs_entry_info_t info = {};
+                snprintf(info.namespace_name, sizeof(info.namespace_name), "%s", ns.first.c_str());
+                snprintf(info.key, sizeof(info.key), "%s", key.first.c_str());
+                info.type = item_type;
+                it->entries.push_back(info);
+            }
+        }
+    }
+
+    if (it->entries.empty()) {
+        delete it;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    *output_iterator = it;
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *iterator)
+{
+    if (iterator == nullptr || *iterator == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    auto *it = *iterator;
+    it->pos += 1;
+    if (it->pos >= it->entries.size()) {
+        delete it;
+        *iterator = nullptr;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t iterator, nvs_entry_info_t *out_info)
+{
+    if (iterator == nullptr || out_info == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *out_info = iterator->entries[iterator->pos];
+    return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    delete iterator;
+}
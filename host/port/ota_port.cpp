@@ -0,0 +1,179 @@
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+
+#ifndef TCFG_HOST_FLASH_DIR
+#define TCFG_HOST_FLASH_DIR "."
+#endif
+
+#ifndef TCFG_HOST_APP_PART_SIZE
+#define TCFG_HOST_APP_PART_SIZE (4 * 1024 * 1024)
+#endif
+
+namespace
+{
+    // Both slots the same size like a normal two-OTA partition table; ota_0 is always the running one
+    esp_partition_t app_parts[2] = {
+        { 0x010000, TCFG_HOST_APP_PART_SIZE, 4096, "ota_0", false, false },
+        { 0x010000 + TCFG_HOST_APP_PART_SIZE, TCFG_HOST_APP_PART_SIZE, 4096, "ota_1", false, false },
+    };
+
+    struct ota_session {
+        const esp_partition_t *part = nullptr;
+        FILE *fp = nullptr;
+        size_t written = 0;
+        size_t limit = 0;
+    };
+
+    std::mutex ota_lock;
+    ota_session curr_ota = {};
+    esp_ota_handle_t last_handle = 0;
+    const esp_partition_t *boot_part = &app_parts[0];
+
+    std::string part_file(const esp_partition_t *part)
+    {
+        return std::string(TCFG_HOST_FLASH_DIR) + "/" + part->label + ".bin";
+    }
+
+    esp_err_t open_session(const esp_partition_t *part, size_t image_size, size_t offset, esp_ota_handle_t *out_handle)
+    {
+        if (part == nullptr || out_handle == nullptr) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (part == esp_ota_get_running_partition()) {
+            return ESP_ERR_OTA_PARTITION_CONFLICT;
+        }
+
+        bool size_known = image_size != OTA_SIZE_UNKNOWN && image_size != OTA_WITH_SEQUENTIAL_WRITES;
+        if ((size_known && image_size > part->size) || offset > part->size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        std::lock_guard<std::mutex> lk(ota_lock);
+        if (curr_ota.fp != nullptr) {
+            fclose(curr_ota.fp);
+        }
+
+        auto path = part_file(part);
+        FILE *fp = offset == 0 ? fopen(path.c_str(), "w+b") : fopen(path.c_str(), "r+b");
+        if (fp == nullptr && offset > 0) {
+            fp = fopen(path.c_str(), "w+b");
+        }
+
+        if (fp == nullptr || ftruncate(fileno(fp), offset) != 0 || fseek(fp, offset, SEEK_SET) != 0) {
+            if (fp != nullptr) {
+                fclose(fp);
+            }
+
+            curr_ota = {};
+            return ESP_FAIL;
+        }
+
+        curr_ota.part = part;
+        curr_ota.fp = fp;
+        curr_ota.written = offset;
+        curr_ota.limit = size_known ? image_size : part->size;
+        last_handle += 1;
+        *out_handle = last_handle;
+        return ESP_OK;
+    }
+
+    esp_err_t close_session(esp_ota_handle_t handle)
+    {
+        std::lock_guard<std::mutex> lk(ota_lock);
+        if (handle != last_handle || curr_ota.fp == nullptr) {
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        bool ok = fclose(curr_ota.fp) == 0;
+        curr_ota = {};
+        return ok ? ESP_OK : ESP_FAIL;
+    }
+}
+
+const esp_partition_t *esp_ota_get_running_partition()
+{
+    return &app_parts[0];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    (void)start_from;
+    return &app_parts[1];
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    return open_session(partition, image_size, 0, out_handle);
+}
+
+esp_err_t esp_ota_resume(const esp_partition_t *partition, size_t erase_size, size_t image_offset, esp_ota_handle_t *out_handle)
+{
+    (void)erase_size;
+    return open_session(partition, OTA_WITH_SEQUENTIAL_WRITES, image_offset, out_handle);
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    std::lock_guard<std::mutex> lk(ota_lock);
+    if (handle != last_handle || curr_ota.fp == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (size > curr_ota.limit - curr_ota.written) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Flushed straight away so esp_partition_read() sees it, like a real flash write would be
+    if (fwrite(data, 1, size, curr_ota.fp) != size || fflush(curr_ota.fp) != 0) {
+        return ESP_FAIL;
+    }
+
+    curr_ota.written += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    return close_session(handle);
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    return close_session(handle);
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    if (partition != &app_parts[0] && partition != &app_parts[1]) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    boot_part = partition;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (partition == nullptr || dst == nullptr || src_offset > partition->size || size > partition->size - src_offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(dst, 0xff, size);
+    FILE *fp = fopen(part_file(partition).c_str(), "rb");
+    if (fp == nullptr) {
+        return ESP_OK; // Never written, reads as erased
+    }
+
+    if (fseek(fp, src_offset, SEEK_SET) == 0) {
+        fread(dst, 1, size, fp);
+    }
+
+    fclose(fp);
+    return ESP_OK;
+}
@@ -0,0 +1,57 @@
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <cstring>
+#include <openssl/sha.h>
+#include <mbedtls/sha256.h>
+
+static_assert(sizeof(SHA256_CTX) <= sizeof(mbedtls_sha256_context::opaque), "SHA256_CTX doesn't fit");
+
+namespace
+{
+    SHA256_CTX *sha_ctx(mbedtls_sha256_context *ctx)
+    {
+        return reinterpret_cast<SHA256_CTX *>(ctx->opaque);
+    }
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    if (ctx != nullptr) {
+        memset(ctx, 0, sizeof(*ctx));
+    }
+}
+
+void mbedtls_sha256_clone(mbedtls_sha256_context *dst, const mbedtls_sha256_context *src)
+{
+    *dst = *src;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    return (is224 ? SHA224_Init(sha_ctx(ctx)) : SHA256_Init(sha_ctx(ctx))) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    return SHA256_Update(sha_ctx(ctx), input, ilen) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char *output)
+{
+    return SHA256_Final(output, sha_ctx(ctx)) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256(const unsigned char *input, size_t ilen, unsigned char *output, int is224)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    int ret = mbedtls_sha256_starts(&ctx, is224);
+    ret = ret ?: mbedtls_sha256_update(&ctx, input, ilen);
+    ret = ret ?: mbedtls_sha256_finish(&ctx, output);
+    mbedtls_sha256_free(&ctx);
+    return ret;
+}
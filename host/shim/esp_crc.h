@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Same conventions as the ROM versions: callers pass and get back the inverted CRC
+uint16_t esp_crc16_be(uint16_t crc, const uint8_t *buf, uint32_t len);
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
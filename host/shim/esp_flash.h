@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef struct esp_flash_t esp_flash_t;
+extern esp_flash_t *esp_flash_default_chip;
+
+esp_err_t esp_flash_read_unique_chip_id(esp_flash_t *chip, uint64_t *out_id);
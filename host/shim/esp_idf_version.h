@@ -0,0 +1,5 @@
+#pragma once
+
+// The host stand-ins implement the 5.3 OTA API, esp_ota_resume() included
+#define ESP_IDF_VERSION_VAL(major, minor, patch) ((major << 16) | (minor << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 3, 0)
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+} esp_reset_reason_t;
+
+esp_reset_reason_t esp_reset_reason();
+
+// Ends the process, there's nothing to come back up
+[[noreturn]] void esp_restart();
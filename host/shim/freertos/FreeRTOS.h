@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+
+// Just enough FreeRTOS for tcfg_client, on std::thread. One tick is one millisecond.
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configMAX_TASK_NAME_LEN 16
+#define tskIDLE_PRIORITY 0
+
+typedef struct tcfg_host_task *TaskHandle_t;
+typedef struct tcfg_host_queue *QueueHandle_t;
+typedef struct tcfg_host_mutex *SemaphoreHandle_t;
+typedef struct tcfg_host_evt_group *EventGroupHandle_t;
+typedef void (*TaskFunction_t)(void *);
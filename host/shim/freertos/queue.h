@@ -0,0 +1,12 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+QueueHandle_t xQueueCreate(UBaseType_t depth, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait_ticks);
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t wait_ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item_out, TickType_t wait_ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
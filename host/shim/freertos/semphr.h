@@ -0,0 +1,9 @@
+#pragma once
+
+#include "queue.h"
+
+// Plain (non-recursive) mutexes only
+SemaphoreHandle_t xSemaphoreCreateMutex();
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait_ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include "nvs.h"
+
+namespace nvs
+{
+enum class ItemType : uint8_t {
+    U8 = 0x01,
+    I8 = 0x11,
+    U16 = 0x02,
+    I16 = 0x12,
+    U32 = 0x04,
+    I32 = 0x14,
+    U64 = 0x08,
+    I64 = 0x18,
+    SZ = 0x21,
+    BLOB = 0x41,
+    BLOB_DATA = 0x42,
+    BLOB_IDX = 0x48,
+    ANY = 0xff,
+};
+
+template<typename T>
+constexpr ItemType itemTypeOf()
+{
+    static_assert(std::is_integral<T>::value && sizeof(T) <= 8, "NVS items are integers up to 64 bits");
+    return static_cast<ItemType>((std::is_signed<T>::value ? 0x10 : 0x00) | sizeof(T));
+}
+
+// Same shape as the IDF class, writes land straight away so commit() has nothing to do
+class NVSHandle
+{
+public:
+    virtual ~NVSHandle() = default;
+
+    template<typename T>
+    esp_err_t set_item(const char *key, T value)
+    {
+        return set_typed_item(itemTypeOf<T>(), key, &value, sizeof(value));
+    }
+
+    template<typename T>
+    esp_err_t get_item(const char *key, T &value)
+    {
+        return get_typed_item(itemTypeOf<T>(), key, &value, sizeof(value));
+    }
+
+    virtual esp_err_t set_typed_item(ItemType datatype, const char *key, const void *data, size_t data_size) = 0;
+    virtual esp_err_t get_typed_item(ItemType datatype, const char *key, void *value, size_t data_size) = 0;
+    virtual esp_err_t set_string(const char *key, const char *str) = 0;
+    virtual esp_err_t get_string(const char *key, char *out_str, size_t len) = 0;
+    virtual esp_err_t set_blob(const char *key, const void *blob, size_t len) = 0;
+    virtual esp_err_t get_blob(const char *key, void *blob, size_t len) = 0;
+    virtual esp_err_t get_item_size(ItemType datatype, const char *key, size_t &size) = 0;
+    virtual esp_err_t erase_item(const char *key) = 0;
+    virtual esp_err_t erase_all() = 0;
+    virtual esp_err_t commit() = 0;
+};
+
+std::unique_ptr<NVSHandle> open_nvs_handle(const char *ns_name, nvs_open_mode_t open_mode, esp_err_t *err = nullptr);
+}
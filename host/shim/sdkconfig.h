@@ -0,0 +1,21 @@
+#pragma once
+
+// Kconfig.projbuild defaults for the host build, edit here instead of menuconfig
+#define CONFIG_TC_PART_NAME "thumbcfg"
+#define CONFIG_TC_MOUNT_PATH "/etc"
+#define CONFIG_TC_FILE_MAX_WINDOW 4
+#define CONFIG_TC_MAX_WIRES 2
+#define CONFIG_TC_RX_TASK_STACK_SIZE 20480
+#define CONFIG_TC_PKT_POOL_BLOCKS 4
+#define CONFIG_TC_PKT_POOL_IN_PSRAM 1
+#define CONFIG_TC_TX_QUEUE_SIZE 65536
+#define CONFIG_TC_FILE_MAX_SESSIONS 4
+#define CONFIG_TC_NVS_CACHE_SIZE 4
+#define CONFIG_TC_OTA_QUEUE_DEPTH 4
+#define CONFIG_TC_CFG_SNAPSHOT_MAX_SIZE 65536
+#define CONFIG_TC_FILE_READ_BUF_SIZE 32768
+#define CONFIG_TC_FILE_HASH_CACHE_SIZE 32
+#define CONFIG_TC_FILE_HASH_CACHE_SAVE_INTERVAL_MS 30000
+#define CONFIG_TC_FILE_WRITE_BUF_SIZE 32768
+#define CONFIG_TC_INFLATE_DICT_SIZE 32768
+#define CONFIG_TC_XFER_CHECKPOINT_INTERVAL 262144
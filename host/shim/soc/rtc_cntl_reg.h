@@ -0,0 +1,6 @@
+#pragma once
+
+// No download mode to force on the host
+#define RTC_CNTL_OPTION1_REG 0
+#define RTC_CNTL_FORCE_DOWNLOAD_BOOT 1
+#define REG_WRITE(reg, val) ((void)(reg), (void)(val))
@@ -0,0 +1,178 @@
+#include <chrono>
+#include <cstring>
+#include "tcfg_wire_loopback.hpp"
+
+tcfg_wire_loopback::tcfg_wire_loopback(size_t _max_pkt_size) : max_pkt_size(_max_pkt_size)
+{
+    rx_stage.resize(max_pkt_size);
+    host_stage.resize(max_pkt_size);
+}
+
+void tcfg_wire_loopback::host_write(const uint8_t *buf, size_t len)
+{
+    std::lock_guard<std::mutex> lk(lock);
+    size_t pos = 0;
+    while (pos < len) {
+        auto evt = tcfg_slip::DECODE_NEED_MORE;
+        pos += tcfg_slip::decode(rx_decoder, buf + pos, len - pos, &evt);
+        if (evt == tcfg_slip::DECODE_FRAME_START) {
+            tcfg_slip::attach(rx_decoder, rx_stage.data(), rx_stage.size());
+        } else if (evt == tcfg_slip::DECODE_FRAME_END) {
+            if (!paused) {
+                rx_frames.push_back(rx_frame { std::vector<uint8_t>(rx_stage.begin(), rx_stage.begin() + rx_decoder.idx), rx_decoder.crc });
+                rx_ready.notify_one();
+            }
+
+            tcfg_slip::detach(rx_decoder);
+        }
+    }
+}
+
+size_t tcfg_wire_loopback::host_read(uint8_t *buf, size_t cap, uint32_t wait_ms)
+{
+    std::unique_lock<std::mutex> lk(lock);
+    if (!tx_ready.wait_for(lk, std::chrono::milliseconds(wait_ms), [this]() { return tx_pos < tx_bytes.size(); })) {
+        return 0;
+    }
+
+    size_t len = std::min(cap, tx_bytes.size() - tx_pos);
+    memcpy(buf, tx_bytes.data() + tx_pos, len);
+    tx_pos += len;
+    if (tx_pos == tx_bytes.size()) {
+        tx_bytes.clear();
+        tx_pos = 0;
+    }
+
+    return len;
+}
+
+void tcfg_wire_loopback::host_send_frame(const uint8_t *frame, size_t len)
+{
+    std::vector<uint8_t> encoded;
+    encoded.reserve(len * 2 + 2);
+    encoded.push_back(tcfg_slip::SLIP_START);
+    slip_append(encoded, frame, len);
+    encoded.push_back(tcfg_slip::SLIP_END);
+    host_write(encoded.data(), encoded.size());
+}
+
+bool tcfg_wire_loopback::host_recv_frame(std::vector<uint8_t> &frame_out, uint32_t wait_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms);
+    uint8_t buf[4096];
+    while (host_frames.empty()) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        size_t len = left > 0 ? host_read(buf, sizeof(buf), (uint32_t)left) : 0;
+        if (len == 0) {
+            return false;
+        }
+
+        size_t pos = 0;
+        while (pos < len) {
+            auto evt = tcfg_slip::DECODE_NEED_MORE;
+            pos += tcfg_slip::decode(host_decoder, buf + pos, len - pos, &evt);
+            if (evt == tcfg_slip::DECODE_FRAME_START) {
+                tcfg_slip::attach(host_decoder, host_stage.data(), host_stage.size());
+            } else if (evt == tcfg_slip::DECODE_FRAME_END) {
+                host_frames.emplace_back(host_stage.begin(), host_stage.begin() + host_decoder.idx);
+                tcfg_slip::detach(host_decoder);
+            }
+        }
+    }
+
+    frame_out = std::move(host_frames.front());
+    host_frames.pop_front();
+    return true;
+}
+
+bool tcfg_wire_loopback::begin_read(uint8_t **data_out, size_t *len_written, uint16_t *crc_out, uint32_t wait_ticks)
+{
+    if (data_out == nullptr) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lk(lock);
+    auto has_frame = [this]() { return !rx_frames.empty(); };
+    if (wait_ticks == portMAX_DELAY) {
+        rx_ready.wait(lk, has_frame);
+    } else if (!rx_ready.wait_for(lk, std::chrono::milliseconds(wait_ticks), has_frame)) {
+        return false;
+    }
+
+    rx_curr = std::move(rx_frames.front());
+    rx_frames.pop_front();
+    *data_out = rx_curr.data.data();
+    if (len_written != nullptr) {
+        *len_written = rx_curr.data.size();
+    }
+
+    if (crc_out != nullptr) {
+        *crc_out = rx_curr.crc;
+    }
+
+    return true;
+}
+
+bool tcfg_wire_loopback::finalise_read(uint8_t *ret_ptr)
+{
+    return ret_ptr != nullptr;
+}
+
+bool tcfg_wire_loopback::write_response(const uint8_t *header_out, size_t header_len, const uint8_t *payload_out, size_t payload_len, uint32_t wait_ticks)
+{
+    (void)wait_ticks;
+    if (header_out == nullptr || header_len < 1) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lk(lock);
+    tx_bytes.push_back(tcfg_slip::SLIP_START);
+    slip_append(tx_bytes, header_out, header_len);
+    if (payload_out != nullptr) {
+        slip_append(tx_bytes, payload_out, payload_len);
+    }
+
+    tx_bytes.push_back(tcfg_slip::SLIP_END);
+    tx_ready.notify_one();
+    return true;
+}
+
+bool tcfg_wire_loopback::flush(uint32_t wait_ticks)
+{
+    (void)wait_ticks;
+    return true;
+}
+
+bool tcfg_wire_loopback::ditch_read()
+{
+    return false;
+}
+
+bool tcfg_wire_loopback::pause(bool force)
+{
+    (void)force;
+    std::lock_guard<std::mutex> lk(lock);
+    paused = true;
+    return true;
+}
+
+bool tcfg_wire_loopback::resume()
+{
+    std::lock_guard<std::mutex> lk(lock);
+    paused = false;
+    return true;
+}
+
+size_t tcfg_wire_loopback::max_packet_size()
+{
+    return max_pkt_size;
+}
+
+void tcfg_wire_loopback::slip_append(std::vector<uint8_t> &out, const uint8_t *buf, size_t len)
+{
+    size_t base = out.size();
+    out.resize(base + len * 2);
+    size_t consumed = 0;
+    size_t written = tcfg_slip::encode(buf, len, out.data() + base, len * 2, &consumed);
+    out.resize(base + written);
+}
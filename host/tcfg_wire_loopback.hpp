@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "tcfg_wire_interface.hpp"
+#include "tcfg_slip.hpp"
+
+// In-memory wire for the host build. The "host" end pushes and pulls the same SLIP byte streams a CDC-ACM port
+// would carry; the device end is what tcfg_client reads from and replies to.
+class tcfg_wire_loopback : public tcfg_wire_if
+{
+public:
+    explicit tcfg_wire_loopback(size_t _max_pkt_size = 8192);
+
+    // Host end, raw bytes. host_write decodes them into frames just like tcfg_wire_usb_cdc::serial_rx_cb does.
+    void host_write(const uint8_t *buf, size_t len);
+    size_t host_read(uint8_t *buf, size_t cap, uint32_t wait_ms);
+
+    // Host end, whole frames (tcfg_client::header + payload): SLIP encode and send, or wait for and decode the next reply
+    void host_send_frame(const uint8_t *frame, size_t len);
+    bool host_recv_frame(std::vector<uint8_t> &frame_out, uint32_t wait_ms);
+
+    // Device end
+    bool begin_read(uint8_t **data_out, size_t *len_written, uint16_t *crc_out, uint32_t wait_ticks) override;
+    bool finalise_read(uint8_t *ret_ptr) override;
+    bool write_response(const uint8_t *header_out, size_t header_len, const uint8_t *payload_out, size_t payload_len, uint32_t wait_ticks) override;
+    bool flush(uint32_t wait_ticks) override;
+    bool ditch_read() override;
+    bool pause(bool force) override;
+    bool resume() override;
+    size_t max_packet_size() override;
+
+private:
+    struct rx_frame {
+        std::vector<uint8_t> data;
+        uint16_t crc;
+    };
+
+    static void slip_append(std::vector<uint8_t> &out, const uint8_t *buf, size_t len);
+
+private:
+    size_t max_pkt_size;
+    std::mutex lock;
+    std::condition_variable rx_ready;
+    std::condition_variable tx_ready;
+
+    std::deque<rx_frame> rx_frames;
+    rx_frame rx_curr = {}; // Handed out by begin_read until finalise_read
+    std::vector<uint8_t> rx_stage;
+    tcfg_slip::decoder rx_decoder = {};
+    bool paused = false;
+
+    std::vector<uint8_t> tx_bytes;
+    size_t tx_pos = 0;
+    std::vector<uint8_t> host_stage;
+    tcfg_slip::decoder host_decoder = {};
+    std::deque<std::vector<uint8_t>> host_frames;
+};
@@ -0,0 +1,463 @@
+// Protocol checks for tcfg_client over tcfg_wire_loopback, run by ctest: malformed path packets, windowed uploads with
+// gaps and retransmits, picking an upload up again, SHA256 rejection and file patching. Exits non-zero on any failure.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <esp_log.h>
+#include <mbedtls/sha256.h>
+#include "tcfg_client.hpp"
+#include "tcfg_delta.hpp"
+#include "tcfg_slip.hpp"
+#include "tcfg_wire_loopback.hpp"
+
+namespace
+{
+    constexpr uint32_t REPLY_TIMEOUT_MS = 5000;
+    constexpr size_t CHUNK_LEN = 1000;
+
+    tcfg_wire_loopback wire;
+
+    void send_req(tcfg_client::pkt_type type, const void *payload, size_t len)
+    {
+        std::vector<uint8_t> frame(sizeof(tcfg_client::header) + len);
+        auto *hdr = (tcfg_client::header *)frame.data();
+        hdr->type = type;
+        hdr->len = len;
+        hdr->crc = 0;
+        if (len > 0) {
+            memcpy(frame.data() + sizeof(tcfg_client::header), payload, len);
+        }
+
+        hdr->crc = tcfg_slip::crc16_update(0, frame.data(), frame.size());
+        wire.host_send_frame(frame.data(), frame.size());
+    }
+
+    // Next reply, checked for type and length; the payload is left in reply_out
+    bool recv_reply(tcfg_client::pkt_type expect, std::vector<uint8_t> &reply_out)
+    {
+        std::vector<uint8_t> frame;
+        if (!wire.host_recv_frame(frame, REPLY_TIMEOUT_MS) || frame.size() < sizeof(tcfg_client::header)) {
+            printf("  no reply (expecting 0x%02x)\n", expect);
+            return false;
+        }
+
+        tcfg_client::header hdr = {};
+        memcpy(&hdr, frame.data(), sizeof(hdr));
+        if (hdr.type != expect || hdr.len != frame.size() - sizeof(hdr)) {
+            printf("  unexpected reply 0x%02x len %u (expecting 0x%02x)\n", hdr.type, hdr.len, expect);
+            return false;
+        }
+
+        reply_out.assign(frame.begin() + sizeof(hdr), frame.end());
+        return true;
+    }
+
+    bool expect_nack(esp_err_t expect)
+    {
+        std::vector<uint8_t> reply;
+        tcfg_client::nack_pkt nack = {};
+        if (!recv_reply(tcfg_client::PKT_NACK, reply) || reply.size() != sizeof(nack)) {
+            return false;
+        }
+
+        memcpy(&nack, reply.data(), sizeof(nack));
+        if (nack.ret != expect) {
+            printf("  NACK with %d, expecting %d\n", (int)nack.ret, (int)expect);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Next PKT_CHUNK_ACK, which must be in `state` with `aux`
+    bool expect_chunk_ack(tcfg_client::chunk_state state, uint32_t aux, std::vector<uint8_t> *reply_out = nullptr)
+    {
+        std::vector<uint8_t> reply;
+        tcfg_client::chunk_ack_pkt ack = {};
+        if (!recv_reply(tcfg_client::PKT_CHUNK_ACK, reply) || reply.size() < sizeof(ack)) {
+            return false;
+        }
+
+        memcpy(&ack, reply.data(), sizeof(ack));
+        if (ack.state != state || ack.aux_info != aux) {
+            printf("  chunk ack %u/%u, expecting %u/%u\n", ack.state, ack.aux_info, state, aux);
+            return false;
+        }
+
+        if (reply_out != nullptr) {
+            *reply_out = reply;
+        }
+
+        return true;
+    }
+
+    std::vector<uint8_t> make_data(size_t len, uint32_t seed)
+    {
+        std::vector<uint8_t> data(len);
+        std::mt19937 rng(seed);
+        for (auto &byte : data) {
+            byte = rng();
+        }
+
+        return data;
+    }
+
+    void data_path(char *path_out, size_t cap, const char *name)
+    {
+        snprintf(path_out, cap, "%s/%s", TCFG_DATA_PATH, name);
+    }
+
+    bool file_exists(const char *path)
+    {
+        struct stat st = {};
+        return stat(path, &st) == 0;
+    }
+
+    bool file_equals(const char *path, const std::vector<uint8_t> &expect)
+    {
+        std::vector<uint8_t> data(expect.size() + 1);
+        FILE *fp = fopen(path, "rb");
+        size_t read_len = fp != nullptr ? fread(data.data(), 1, data.size(), fp) : 0;
+        if (fp != nullptr) {
+            fclose(fp);
+        }
+
+        return read_len == expect.size() && memcmp(data.data(), expect.data(), expect.size()) == 0;
+    }
+
+    void begin_write(const char *path, size_t len, const tcfg_client::file_write_opts &opts)
+    {
+        std::vector<uint8_t> req(sizeof(tcfg_client::path_pkt) + sizeof(opts));
+        auto *path_req = (tcfg_client::path_pkt *)req.data();
+        path_req->len = len;
+        snprintf(path_req->path, sizeof(path_req->path), "%s", path);
+        memcpy(req.data() + sizeof(tcfg_client::path_pkt), &opts, sizeof(opts));
+        send_req(tcfg_client::PKT_BEGIN_FILE_WRITE, req.data(), req.size());
+    }
+
+    void send_chunk_at(const std::vector<uint8_t> &data, size_t idx)
+    {
+        size_t offset = idx * CHUNK_LEN;
+        size_t len = std::min(CHUNK_LEN, data.size() - offset);
+        std::vector<uint8_t> req(sizeof(tcfg_client::file_chunk_pkt) + len);
+        auto *chunk = (tcfg_client::file_chunk_pkt *)req.data();
+        chunk->offset = offset;
+        memcpy(chunk->data, data.data() + offset, len);
+        send_req(tcfg_client::PKT_FILE_CHUNK_AT, req.data(), req.size());
+    }
+
+    // Collects acks until the upload is done, which must come back with the SHA256 of `data`
+    bool expect_upload_done(const std::vector<uint8_t> &data)
+    {
+        uint8_t hash[32] = {};
+        mbedtls_sha256(data.data(), data.size(), hash, 0);
+
+        std::vector<uint8_t> reply;
+        tcfg_client::file_done_ack_pkt done = {};
+        while (true) {
+            if (!recv_reply(tcfg_client::PKT_CHUNK_ACK, reply) || reply.empty()) {
+                return false;
+            }
+
+            if (reply[0] != tcfg_client::CHUNK_XFER_NEXT) {
+                break;
+            }
+        }
+
+        if (reply.size() != sizeof(done)) {
+            printf("  final ack is %zu bytes\n", reply.size());
+            return false;
+        }
+
+        memcpy(&done, reply.data(), sizeof(done));
+        if (done.state != tcfg_client::CHUNK_XFER_DONE || done.aux_info != data.size() || memcmp(done.hash, hash, sizeof(hash)) != 0) {
+            printf("  upload ended with state %u, %u bytes\n", done.state, done.aux_info);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool test_path_pkts()
+    {
+        tcfg_client::path_pkt req = {};
+        char path[UINT8_MAX] = {};
+        data_path(path, sizeof(path), "short_path.bin");
+        FILE *fp = fopen(path, "wb");
+        if (fp == nullptr || fwrite("abc", 1, 3, fp) != 3) {
+            printf("  can't create %s\n", path);
+            return false;
+        }
+
+        fclose(fp);
+
+        // Cut off before the path starts
+        send_req(tcfg_client::PKT_GET_FILE_INFO, &req, offsetof(tcfg_client::path_pkt, path));
+        if (!expect_nack(ESP_ERR_INVALID_SIZE)) {
+            return false;
+        }
+
+        // Full length, but never terminated
+        memset(req.path, 'a', sizeof(req.path));
+        send_req(tcfg_client::PKT_GET_FILE_INFO, &req, sizeof(req));
+        if (!expect_nack(ESP_ERR_INVALID_SIZE)) {
+            return false;
+        }
+
+        // Cut short, and the terminator is missing from what did arrive
+        send_req(tcfg_client::PKT_GET_FILE_INFO, &req, offsetof(tcfg_client::path_pkt, path) + 8);
+        if (!expect_nack(ESP_ERR_INVALID_SIZE)) {
+            return false;
+        }
+
+        // Cut short right after the terminator is fine
+        memset(req.path, 0, sizeof(req.path));
+        snprintf(req.path, sizeof(req.path), "%s", path);
+        size_t short_len = offsetof(tcfg_client::path_pkt, path) + strlen(path) + 1;
+        send_req(tcfg_client::PKT_GET_FILE_INFO, &req, short_len);
+        std::vector<uint8_t> reply;
+        if (!recv_reply(tcfg_client::PKT_FILE_INFO, reply) || ((tcfg_client::file_info_pkt *)reply.data())->size != 3) {
+            return false;
+        }
+
+        send_req(tcfg_client::PKT_DELETE_FILE, &req, short_len);
+        if (!recv_reply(tcfg_client::PKT_ACK, reply) || file_exists(path)) {
+            unlink(path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool test_window_gaps()
+    {
+        char path[UINT8_MAX] = {};
+        data_path(path, sizeof(path), "window.bin");
+        auto data = make_data(16 * CHUNK_LEN, 3);
+
+        tcfg_client::file_write_opts opts = {};
+        opts.window = 4; // Acked every 2 chunks
+        begin_write(path, data.size(), opts);
+        std::vector<uint8_t> reply;
+        if (!recv_reply(tcfg_client::PKT_CHUNK_ACK, reply) || ((tcfg_client::file_begin_ack_pkt *)reply.data())->window != 4) {
+            return false;
+        }
+
+        send_chunk_at(data, 0);
+        send_chunk_at(data, 2); // Chunk 1 lost: told to go on from 1000
+        if (!expect_chunk_ack(tcfg_client::CHUNK_XFER_NEXT, CHUNK_LEN)) {
+            return false;
+        }
+
+        send_chunk_at(data, 3); // Same gap, no second ack for it
+        send_chunk_at(data, 1);
+        send_chunk_at(data, 2);
+        if (!expect_chunk_ack(tcfg_client::CHUNK_XFER_NEXT, 3 * CHUNK_LEN)) {
+            return false;
+        }
+
+        send_chunk_at(data, 1); // Retransmit of something already written
+        if (!expect_chunk_ack(tcfg_client::CHUNK_XFER_NEXT, 3 * CHUNK_LEN)) {
+            return false;
+        }
+
+        for (size_t idx = 3; idx < 16; idx += 1) {
+            send_chunk_at(data, idx);
+        }
+
+        bool ok = expect_upload_done(data) && file_equals(path, data);
+        unlink(path);
+        return ok;
+    }
+
+    bool test_resume()
+    {
+        char path[UINT8_MAX] = {};
+        data_path(path, sizeof(path), "resume.bin");
+        auto data = make_data(6 * CHUNK_LEN, 18);
+
+        tcfg_client::file_write_opts opts = {};
+        opts.xfer_id = 0x1801;
+        begin_write(path, data.size(), opts);
+        if (!expect_chunk_ack(tcfg_client::CHUNK_XFER_NEXT, 0)) {
+            return false;
+        }
+
+        for (size_t idx = 0; idx < 3; idx += 1) {
+            send_chunk_at(data, idx);
+            if (!expect_chunk_ack(tcfg_client::CHUNK_XFER_NEXT, (idx + 1) * CHUNK_LEN)) {
+                return false;
+            }
+        }
+
+        // Link dropped and came back: the same begin goes on from what was acked
+        begin_write(path, data.size(), opts);
+        if (!expect_chunk_ack(tcfg_client::CHUNK_XFER_NEXT, 3 * CHUNK_LEN)) {
+            return false;
+        }
+
+        for (size_t idx = 3; idx < 6; idx += 1) {
+            send_chunk_at(data, idx);
+        }
+
+        bool ok = expect_upload_done(data) && file_equals(path, data);
+        unlink(path);
+        return ok;
+    }
+
+    bool test_hash_mismatch()
+    {
+        char path[UINT8_MAX] = {};
+        data_path(path, sizeof(path), "mismatch.bin");
+        auto data = make_data(4 * CHUNK_LEN, 14);
+        uint8_t hash[32] = {};
+        mbedtls_sha256(data.data(), data.size(), hash, 0);
+
+        tcfg_client::file_write_opts opts = {};
+        opts.flags = tcfg_client::FILE_WRITE_VERIFY_SHA256;
+        memcpy(opts.hash, hash, sizeof(opts.hash));
+        opts.hash[0] ^= 0xff;
+        begin_write(path, data.size(), opts);
+        if (!expect_chunk_ack(tcfg_client::CHUNK_XFER_NEXT, 0)) {
+            return false;
+        }
+
+        std::vector<uint8_t> reply;
+        for (size_t idx = 0; idx < 4; idx += 1) {
+            send_chunk_at(data, idx);
+            auto state = idx < 3 ? tcfg_client::CHUNK_XFER_NEXT : tcfg_client::CHUNK_ERR_HASH_MISMATCH;
+            if (!expect_chunk_ack(state, idx < 3 ? (idx + 1) * CHUNK_LEN : data.size(), &reply)) {
+                return false;
+            }
+        }
+
+        // Still tells the host what it did get
+        if (reply.size() != sizeof(tcfg_client::file_done_ack_pkt) || memcmp(((tcfg_client::file_done_ack_pkt *)reply.data())->hash, hash, sizeof(hash)) != 0) {
+            printf("  mismatch ack doesn't carry the received hash\n");
+            return false;
+        }
+
+        if (file_exists(path)) {
+            printf("  %s left behind\n", path);
+            unlink(path);
+            return false;
+        }
+
+        return true;
+    }
+
+    void append(std::vector<uint8_t> &out, const void *buf, size_t len)
+    {
+        out.insert(out.end(), (const uint8_t *)buf, (const uint8_t *)buf + len);
+    }
+
+    bool send_patch(const char *path, const std::vector<uint8_t> &ops, size_t block_size, const std::vector<uint8_t> &expect, bool corrupt_hash)
+    {
+        tcfg_client::file_patch_begin_pkt begin = {};
+        begin.block_size = block_size;
+        begin.out_len = expect.size();
+        mbedtls_sha256(expect.data(), expect.size(), begin.hash, 0);
+        begin.hash[0] ^= corrupt_hash ? 0xff : 0;
+        snprintf(begin.path, sizeof(begin.path), "%s", path);
+        send_req(tcfg_client::PKT_BEGIN_FILE_PATCH, &begin, sizeof(begin));
+        if (!expect_chunk_ack(tcfg_client::CHUNK_XFER_NEXT, 0)) {
+            return false;
+        }
+
+        std::vector<uint8_t> req(sizeof(tcfg_client::stream_chunk_pkt));
+        auto *chunk = (tcfg_client::stream_chunk_pkt *)req.data();
+        chunk->offset = 0;
+        chunk->flags = tcfg_client::STREAM_LAST;
+        append(req, ops.data(), ops.size());
+        send_req(tcfg_client::PKT_FILE_PATCH_CHUNK, req.data(), req.size());
+        return corrupt_hash ? expect_nack(ESP_ERR_INVALID_CRC) : expect_chunk_ack(tcfg_client::CHUNK_XFER_DONE, expect.size());
+    }
+
+    bool test_patch()
+    {
+        constexpr size_t BLOCK = 64; // Smallest block size tcfg_client takes
+        char path[UINT8_MAX] = {};
+        char tmp_path[UINT8_MAX + 8] = {};
+        char bak_path[UINT8_MAX + 8] = {};
+        data_path(path, sizeof(path), "patch.bin");
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+        snprintf(bak_path, sizeof(bak_path), "%s.bak", path);
+
+        auto old_data = make_data(4 * BLOCK, 12);
+        FILE *fp = fopen(path, "wb");
+        if (fp == nullptr || fwrite(old_data.data(), 1, old_data.size(), fp) != old_data.size()) {
+            printf("  can't create %s\n", path);
+            return false;
+        }
+
+        fclose(fp);
+
+        // Block 0, some new bytes, then blocks 2..3
+        const char literal[] = "patched";
+        std::vector<uint8_t> new_data(old_data.begin(), old_data.begin() + BLOCK);
+        append(new_data, literal, sizeof(literal));
+        append(new_data, old_data.data() + 2 * BLOCK, 2 * BLOCK);
+
+        std::vector<uint8_t> ops;
+        tcfg_delta::copy_op copy = { tcfg_delta::OP_COPY, 0, 1 };
+        tcfg_delta::literal_op lit = { tcfg_delta::OP_LITERAL, sizeof(literal) };
+        append(ops, &copy, sizeof(copy));
+        append(ops, &lit, sizeof(lit));
+        append(ops, literal, sizeof(literal));
+        copy = { tcfg_delta::OP_COPY, 2, 2 };
+        append(ops, &copy, sizeof(copy));
+
+        // A patch that fails verification leaves the old file alone
+        if (!send_patch(path, ops, BLOCK, new_data, true) || !file_equals(path, old_data)) {
+            printf("  failed patch touched %s\n", path);
+            return false;
+        }
+
+        bool ok = send_patch(path, ops, BLOCK, new_data, false) && file_equals(path, new_data);
+        if (ok && (file_exists(tmp_path) || file_exists(bak_path))) {
+            printf("  patch left %s or %s behind\n", tmp_path, bak_path);
+            ok = false;
+        }
+
+        unlink(path);
+        return ok;
+    }
+
+    struct test_case {
+        const char *name;
+        bool (*run)();
+    };
+}
+
+int main()
+{
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    if (tcfg_client::instance()->init(&wire) != ESP_OK) {
+        printf("tcfg_client init failed, does %s exist?\n", TCFG_DATA_PATH);
+        return 1;
+    }
+
+    const test_case cases[] = {
+        { "path packets", test_path_pkts },
+        { "window gaps", test_window_gaps },
+        { "resume", test_resume },
+        { "hash mismatch", test_hash_mismatch },
+        { "patch", test_patch },
+    };
+
+    int failed = 0;
+    for (const auto &tc : cases) {
+        bool ok = tc.run();
+        printf("%-24s %s\n", tc.name, ok ? "ok" : "FAILED");
+        failed += ok ? 0 : 1;
+    }
+
+    // Receive tasks are still blocked in the wire, skip static destructors rather than pull it out from under them
+    fflush(stdout);
+    std::_Exit(failed == 0 ? 0 : 1);
+}
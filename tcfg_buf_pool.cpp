@@ -0,0 +1,81 @@
+#include <cstdlib>
+#include "tcfg_buf_pool.hpp"
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+tcfg_buf_pool::~tcfg_buf_pool()
+{
+    free(arena);
+}
+
+bool tcfg_buf_pool::init(size_t block_size, size_t count, bool in_psram)
+{
+    if (arena != nullptr || block_size == 0 || count == 0 || count > MAX_BLOCKS) {
+        return false;
+    }
+
+    // Keep every block word aligned so packet structs can be laid straight over them
+    block_size = (block_size + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+
+#ifdef ESP_PLATFORM
+    arena = (uint8_t *)heap_caps_malloc(block_size * count, in_psram ? MALLOC_CAP_SPIRAM : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+#else
+    (void)in_psram;
+    arena = (uint8_t *)malloc(block_size * count);
+#endif
+    if (arena == nullptr) {
+        return false;
+    }
+
+    blk_size = block_size;
+    blk_count = count;
+    free_mask.store(count == 32 ? UINT32_MAX : (1UL << count) - 1, std::memory_order_release);
+    return true;
+}
+
+uint8_t *tcfg_buf_pool::borrow()
+{
+    uint32_t mask = free_mask.load(std::memory_order_relaxed);
+    while (mask != 0) {
+        uint32_t bit = mask & (~mask + 1);
+        if (free_mask.compare_exchange_weak(mask, mask & ~bit, std::memory_order_acquire, std::memory_order_relaxed)) {
+            borrows.fetch_add(1, std::memory_order_relaxed);
+            uint32_t now = in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+            uint32_t prev = peak.load(std::memory_order_relaxed);
+            while (now > prev && !peak.compare_exchange_weak(prev, now, std::memory_order_relaxed)) {}
+
+            return arena + (size_t)__builtin_ctz(bit) * blk_size;
+        }
+    }
+
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void tcfg_buf_pool::give_back(uint8_t *buf)
+{
+    if (buf == nullptr || buf < arena || buf >= arena + blk_size * blk_count) {
+        return;
+    }
+
+    size_t idx = (size_t)(buf - arena) / blk_size;
+    in_use.fetch_sub(1, std::memory_order_relaxed);
+    free_mask.fetch_or(1UL << idx, std::memory_order_release);
+}
+
+size_t tcfg_buf_pool::block_size() const
+{
+    return blk_size;
+}
+
+tcfg_buf_pool::stats tcfg_buf_pool::get_stats() const
+{
+    tcfg_buf_pool::stats out = {};
+    out.in_use = in_use.load(std::memory_order_relaxed);
+    out.peak = peak.load(std::memory_order_relaxed);
+    out.borrows = borrows.load(std::memory_order_relaxed);
+    out.misses = misses.load(std::memory_order_relaxed);
+    return out;
+}
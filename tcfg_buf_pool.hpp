@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Fixed number of fixed-size buffers carved out of one allocation. Lock free, so any task can borrow and give back.
+class tcfg_buf_pool
+{
+public:
+    static const constexpr size_t MAX_BLOCKS = 32;
+
+    struct stats {
+        uint32_t in_use;
+        uint32_t peak;    // Most ever out at once
+        uint32_t borrows;
+        uint32_t misses;  // Borrows that found the pool empty
+    };
+
+public:
+    tcfg_buf_pool() = default;
+    ~tcfg_buf_pool();
+    tcfg_buf_pool(tcfg_buf_pool const &) = delete;
+    void operator=(tcfg_buf_pool const &) = delete;
+
+    // in_psram picks where the blocks live on the chip, the host build ignores it
+    bool init(size_t block_size, size_t count, bool in_psram);
+
+    // Returns nullptr when every block is out, never blocks
+    uint8_t *borrow();
+    void give_back(uint8_t *buf);
+
+    size_t block_size() const;
+    tcfg_buf_pool::stats get_stats() const;
+
+private:
+    uint8_t *arena = nullptr;
+    size_t blk_size = 0;
+    size_t blk_count = 0;
+    std::atomic<uint32_t> free_mask { 0 };
+    std::atomic<uint32_t> in_use { 0 };
+    std::atomic<uint32_t> peak { 0 };
+    std::atomic<uint32_t> borrows { 0 };
+    std::atomic<uint32_t> misses { 0 };
+};
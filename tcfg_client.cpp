@@ -1,27 +1,89 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/event_groups.h>
 #include <esp_log.h>
 #include <esp_crc.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cerrno>
 #include <cstring>
+#include <algorithm>
 #include <nvs_handle.hpp>
 #include <mbedtls/sha256.h>
 #include <esp_ota_ops.h>
 #include <esp_mac.h>
 #include <esp_flash.h>
 #include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
 #include <soc/rtc_cntl_reg.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
 #include "tcfg_client.hpp"
+#include "tcfg_slip.hpp"
+#include "tcfg_fs.hpp"
+
+// esp_ota_resume() only exists from IDF 5.3 on; before that an OTA can only be picked up again without a reboot
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#define TC_OTA_CAN_RESUME 1
+#else
+#define TC_OTA_CAN_RESUME 0
+#endif
+
+static_assert(offsetof(tcfg_client::header, crc) == tcfg_slip::FRAME_CRC_OFFSET && sizeof(tcfg_client::header::crc) == tcfg_slip::FRAME_CRC_LEN,
+              "SLIP decoder's CRC skip range must match the header CRC field");
+static_assert((CONFIG_TC_INFLATE_DICT_SIZE & (CONFIG_TC_INFLATE_DICT_SIZE - 1)) == 0, "CONFIG_TC_INFLATE_DICT_SIZE must be a power of two");
+
+thread_local tcfg_wire_if *tcfg_client::curr_wire = nullptr;
 
 esp_err_t tcfg_client::init(tcfg_wire_if *_wire_if)
 {
-    wire_if = _wire_if;
-    if (wire_if == nullptr) {
+    if (_wire_if == nullptr) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (xTaskCreateWithCaps(rx_task, "tcfg_wire_rx", 20480, this, tskIDLE_PRIORITY + 1, &rx_task_handle, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA) != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to create receive task");
+    // Everything but the wire is shared, so only the first call sets it up
+    if (state_evt_group == nullptr) {
+        auto ret = init_shared();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    for (size_t idx = 0; idx < CONFIG_TC_MAX_WIRES; idx += 1) {
+        auto &slot = wires[idx];
+        if (slot.wire == _wire_if) {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        if (slot.wire != nullptr) {
+            continue;
+        }
+
+        char task_name[configMAX_TASK_NAME_LEN] = {};
+        snprintf(task_name, sizeof(task_name), "tcfg_wire_rx%zu", idx);
+        slot.wire = _wire_if;
+        if (xTaskCreateWithCaps(rx_task, task_name, CONFIG_TC_RX_TASK_STACK_SIZE, &slot, tskIDLE_PRIORITY + 1, &slot.rx_task, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA) != pdTRUE) {
+            ESP_LOGE(TAG, "Failed to create receive task");
+            slot.wire = nullptr;
+            return ESP_ERR_NO_MEM;
+        }
+
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "No room for another wire, raise CONFIG_TC_MAX_WIRES");
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t tcfg_client::init_shared()
+{
+    cfg_lock = xSemaphoreCreateMutex();
+    file_lock = xSemaphoreCreateMutex();
+    ota_lock = xSemaphoreCreateMutex();
+    if (cfg_lock == nullptr || file_lock == nullptr || ota_lock == nullptr) {
+        ESP_LOGE(TAG, "Failed to create locks");
         return ESP_ERR_NO_MEM;
     }
 
@@ -31,23 +93,44 @@ esp_err_t tcfg_client::init(tcfg_wire_if *_wire_if)
         return ESP_ERR_NO_MEM;
     }
 
+    ota_free_q = xQueueCreate(CONFIG_TC_OTA_QUEUE_DEPTH, sizeof(uint8_t *));
+    ota_write_q = xQueueCreate(CONFIG_TC_OTA_QUEUE_DEPTH, sizeof(tcfg_client::ota_job));
+    if (ota_free_q == nullptr || ota_write_q == nullptr) {
+        ESP_LOGE(TAG, "Failed to create OTA queues");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Reply buffers for the handlers that build multi-entry frames, borrowed instead of sitting on every receive task's stack
+    if (!pkt_pool.init(PKT_BUF_SIZE, CONFIG_TC_PKT_POOL_BLOCKS, PKT_POOL_IN_PSRAM)) {
+        ESP_LOGE(TAG, "Failed to allocate packet buffer pool");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Flash writes run with cache disabled, so this one must have its stack in internal RAM
+    if (xTaskCreateWithCaps(ota_write_task, "tcfg_ota_wr", 6144, this, tskIDLE_PRIORITY + 1, &ota_task_handle, MALLOC_CAP_INTERNAL) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to create OTA write task");
+        return ESP_ERR_NO_MEM;
+    }
+
     // Do this only in main task (NOT in any other task in PSRAM) or it may crash
     auto *desc = esp_app_get_description();
     if (desc->magic_word != ESP_APP_DESC_MAGIC_WORD) {
         ESP_LOGW(TAG, "DevInfo: invalid magic"); // Should we NACK here???
     }
 
-    strncpy(dev_info.comp_date, desc->date, sizeof(device_info_pkt::comp_date));
-    strncpy(dev_info.comp_time, desc->time, sizeof(device_info_pkt::comp_time));
-    strncpy(dev_info.fw_ver, desc->version, sizeof(device_info_pkt::fw_ver));
-    strncpy(dev_info.sdk_ver, desc->idf_ver, sizeof(device_info_pkt::sdk_ver));
-    strncpy(dev_info.model_name, desc->project_name, sizeof(device_info_pkt::model_name));
+    snprintf(dev_info.comp_date, sizeof(device_info_pkt::comp_date), "%s", desc->date);
+    snprintf(dev_info.comp_time, sizeof(device_info_pkt::comp_time), "%s", desc->time);
+    snprintf(dev_info.fw_ver, sizeof(device_info_pkt::fw_ver), "%s", desc->version);
+    // idf_ver is twice as long as the wire field, long dev build versions get cut
+    snprintf(dev_info.sdk_ver, sizeof(device_info_pkt::sdk_ver), "%.*s", (int)sizeof(device_info_pkt::sdk_ver) - 1, desc->idf_ver);
+    snprintf(dev_info.model_name, sizeof(device_info_pkt::model_name), "%s", desc->project_name);
     memcpy(dev_info.fw_hash, desc->app_elf_sha256, sizeof(device_info_pkt::fw_hash));
-    dev_info.max_pkt_size = wire_if->max_packet_size();
 
     // Do this only in main task (NOT in any other task in PSRAM) or it may crash
+    uint64_t flash_id = 0;
     auto ret = esp_efuse_mac_get_default(dev_info.mac_addr);
-    ret = ret ?: esp_flash_read_unique_chip_id(esp_flash_default_chip, (uint64_t *)dev_info.flash_id);
+    ret = ret ?: esp_flash_read_unique_chip_id(esp_flash_default_chip, &flash_id);
+    memcpy(dev_info.flash_id, &flash_id, sizeof(device_info_pkt::flash_id));
 
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to read UID! ret=%d %s", ret, esp_err_to_name(ret));
@@ -66,21 +149,31 @@ esp_err_t tcfg_client::init(tcfg_wire_if *_wire_if)
         return ESP_ERR_INVALID_STATE;
     }
 
+    ret = hash_cache.init(HASH_CACHE_PATH, CONFIG_TC_FILE_HASH_CACHE_SIZE, CONFIG_TC_FILE_HASH_CACHE_SAVE_INTERVAL_MS);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "File hash cache disabled, ret=%d %s", ret, esp_err_to_name(ret));
+    }
+
     return ESP_OK;
 }
 
 void tcfg_client::rx_task(void *_ctx)
 {
-    auto *ctx = (tcfg_client *)_ctx;
+    auto *slot = (tcfg_client::wire_slot *)_ctx;
+    auto *ctx = tcfg_client::instance();
+
+    // Everything this task sends goes back out the wire it's reading from
+    curr_wire = slot->wire;
 
     while (true) {
-        if (ctx == nullptr) {
+        if (slot == nullptr) {
             break;
         }
 
         uint8_t *pkt_ptr = nullptr;
         size_t read_len = 0;
-        if (!ctx->wire_if->begin_read(&pkt_ptr, &read_len, portMAX_DELAY)) {
+        uint16_t frame_crc = 0;
+        if (!curr_wire->begin_read(&pkt_ptr, &read_len, &frame_crc, portMAX_DELAY)) {
             ESP_LOGE(TAG, "Rx: read fail");
             vTaskDelay(1);
             continue;
@@ -92,33 +185,206 @@ void tcfg_client::rx_task(void *_ctx)
             continue;
         }
 
-        ctx->handle_rx_pkt(pkt_ptr, read_len);
-        ctx->wire_if->finalise_read(pkt_ptr);
+        ctx->handle_rx_pkt(pkt_ptr, read_len, frame_crc);
+        curr_wire->finalise_read(pkt_ptr);
+    }
+
+    vTaskDelete(nullptr);
+}
+
+void tcfg_client::ota_write_task(void *_ctx)
+{
+    auto *ctx = (tcfg_client *)_ctx;
+
+    while (true) {
+        if (ctx == nullptr) {
+            break;
+        }
+
+        tcfg_client::ota_job job = {};
+        if (xQueueReceive(ctx->ota_write_q, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        // Once a write failed, keep recycling buffers but don't touch the flash until the next begin
+        if (ctx->ota_write_ret == ESP_OK) {
+            auto ret = esp_ota_write(ctx->ota_handle, job.buf, job.len);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "OTA failed to write chunk! ret=%d %s", ret, esp_err_to_name(ret));
+                ctx->ota_write_ret = ret;
+            } else if (ctx->ota_next_ckpt != 0) {
+                ctx->track_ota_written(job.buf, job.len);
+            }
+        }
+
+        xQueueSend(ctx->ota_free_q, &job.buf, portMAX_DELAY);
     }
 
     vTaskDelete(nullptr);
 }
 
-void tcfg_client::handle_rx_pkt(const uint8_t *buf, size_t decoded_len)
+void tcfg_client::handle_rx_pkt(const uint8_t *buf, size_t decoded_len, uint16_t frame_crc)
 {
     if (buf == nullptr || decoded_len < sizeof(tcfg_client::header)) {
         return;
     }
 
-    auto *header = (tcfg_client::header *)buf;
-
-    uint16_t expected_crc = header->crc;
-    header->crc = 0;
+    auto *header = (const tcfg_client::header *)buf;
 
+    // The wire worked out the CRC while decoding, so the payload doesn't have to be read again here
     size_t pkt_len_with_hdr = header->len + sizeof(tcfg_client::header);
-    uint16_t actual_crc = get_crc16(buf, pkt_len_with_hdr);
-    if (actual_crc != expected_crc) {
-        ESP_LOGE(TAG, "Incoming packet CRC corrupted, expect 0x%x, actual 0x%x pkt len %u decode len %u", expected_crc, actual_crc, pkt_len_with_hdr, decoded_len);
+    if (frame_crc != header->crc || pkt_len_with_hdr != decoded_len) {
+        ESP_LOGE(TAG, "Incoming packet CRC corrupted, expect 0x%x, actual 0x%x pkt len %zu decode len %zu", header->crc, frame_crc, pkt_len_with_hdr, decoded_len);
 
         send_nack();
         return;
     }
 
+    // Items are queued at their decoded size, so a short frame must never reach a handler that reads a whole struct
+    if (header->len < min_payload_len(header->type)) {
+        ESP_LOGE(TAG, "Packet 0x%x too short: %u bytes", header->type, header->len);
+        send_nack(ESP_ERR_INVALID_SIZE);
+        return;
+    }
+
+    // Only requests touching the same state wait for each other, so e.g. an OTA stalled on flash on one
+    // wire doesn't hold up config traffic on another
+    SemaphoreHandle_t lock = lock_for(header->type);
+    if (lock != nullptr) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+    }
+
+    dispatch_pkt(buf);
+
+    if (lock != nullptr) {
+        xSemaphoreGive(lock);
+    }
+}
+
+SemaphoreHandle_t tcfg_client::lock_for(uint8_t type) const
+{
+    switch (type) {
+        case PKT_GET_CONFIG:
+        case PKT_SET_CONFIG:
+        case PKT_DEL_CONFIG:
+        case PKT_NUKE_CONFIG:
+        case PKT_GET_CONFIG_BATCH:
+        case PKT_SET_CONFIG_BATCH:
+        case PKT_LIST_CONFIG:
+        case PKT_EXPORT_CONFIG:
+        case PKT_IMPORT_CONFIG_BEGIN:
+        case PKT_IMPORT_CONFIG_CHUNK: {
+            return cfg_lock;
+        }
+
+        // PKT_FILE_READ and PKT_GET_FILE_SIG only use their own FILE, they can run alongside anything
+        case PKT_BEGIN_FILE_WRITE:
+        case PKT_FILE_CHUNK:
+        case PKT_FILE_CHUNK_AT:
+        case PKT_FILE_SESSION_CHUNK:
+        case PKT_BEGIN_FILE_PATCH:
+        case PKT_FILE_PATCH_CHUNK:
+        case PKT_DELETE_FILE:
+        case PKT_GET_FILE_INFO: {
+            return file_lock;
+        }
+
+        case PKT_BEGIN_OTA:
+        case PKT_OTA_CHUNK:
+        case PKT_OTA_COMMIT: {
+            return ota_lock;
+        }
+
+        default: {
+            return nullptr;
+        }
+    }
+}
+
+bool tcfg_client::cfg_names_valid(const char *ns, const char *key)
+{
+    // Both are fixed 16-byte fields on the wire, only usable as NVS names if terminated inside them
+    return memchr(ns, '\0', sizeof(tcfg_client::cfg_pkt::ns)) != nullptr && memchr(key, '\0', sizeof(tcfg_client::cfg_pkt::key)) != nullptr;
+}
+
+size_t tcfg_client::min_payload_len(uint8_t type)
+{
+    // Fixed part of each request; anything variable after it is checked by the case in dispatch_pkt()
+    switch (type) {
+        case PKT_GET_CONFIG:
+        case PKT_SET_CONFIG: {
+            return sizeof(tcfg_client::cfg_pkt);
+        }
+
+        case PKT_GET_CONFIG_BATCH: {
+            return sizeof(tcfg_client::cfg_batch_req_pkt);
+        }
+
+        case PKT_SET_CONFIG_BATCH: {
+            return sizeof(tcfg_client::cfg_set_batch_req_pkt);
+        }
+
+        case PKT_DEL_CONFIG: {
+            return sizeof(tcfg_client::del_cfg_pkt);
+        }
+
+        case PKT_NUKE_CONFIG: {
+            return sizeof(tcfg_client::del_cfg_pkt::ns);
+        }
+
+        case PKT_IMPORT_CONFIG_BEGIN: {
+            return sizeof(tcfg_client::cfg_import_begin_pkt);
+        }
+
+        case PKT_IMPORT_CONFIG_CHUNK:
+        case PKT_FILE_PATCH_CHUNK: {
+            return sizeof(tcfg_client::stream_chunk_pkt);
+        }
+
+        case PKT_BEGIN_FILE_WRITE:
+        case PKT_DELETE_FILE:
+        case PKT_GET_FILE_INFO: {
+            return offsetof(tcfg_client::path_pkt, path) + 1; // The path may be cut short after its terminator, see read_path_pkt()
+        }
+
+        case PKT_FILE_CHUNK_AT: {
+            return sizeof(tcfg_client::file_chunk_pkt);
+        }
+
+        case PKT_FILE_SESSION_CHUNK: {
+            return sizeof(tcfg_client::session_chunk_pkt);
+        }
+
+        case PKT_FILE_READ: {
+            return sizeof(tcfg_client::file_read_req_pkt);
+        }
+
+        case PKT_GET_FILE_SIG: {
+            return sizeof(tcfg_client::file_sig_req_pkt);
+        }
+
+        case PKT_BEGIN_FILE_PATCH: {
+            return sizeof(tcfg_client::file_patch_begin_pkt);
+        }
+
+        default: {
+            return 0; // No payload, or one that's optional and copied into a zeroed struct (uptime, OTA begin)
+        }
+    }
+}
+
+bool tcfg_client::read_path_pkt(const uint8_t *payload, size_t len, tcfg_client::path_pkt *pkt_out)
+{
+    // Hosts have always been free to send only the used part of the path, as long as the terminator is in it
+    *pkt_out = {};
+    size_t path_len = std::min(len - offsetof(tcfg_client::path_pkt, path), sizeof(tcfg_client::path_pkt::path));
+    memcpy(pkt_out, payload, offsetof(tcfg_client::path_pkt, path) + path_len);
+    return memchr(pkt_out->path, '\0', path_len) != nullptr;
+}
+
+void tcfg_client::dispatch_pkt(const uint8_t *buf)
+{
+    auto *header = (const tcfg_client::header *)buf;
     switch (header->type) {
         case PKT_GET_DEVICE_INFO: {
             send_dev_info();
@@ -127,24 +393,94 @@ void tcfg_client::handle_rx_pkt(const uint8_t *buf, size_t decoded_len)
 
         case PKT_GET_CONFIG: {
             auto *payload = (tcfg_client::cfg_pkt *)(buf + sizeof(tcfg_client::header));
+            if (!cfg_names_valid(payload->ns, payload->key)) {
+                send_nack(ESP_ERR_INVALID_ARG);
+                break;
+            }
+
             get_cfg_from_nvs(payload->ns, payload->key, payload->type);
             break;
         }
 
+        case PKT_GET_CONFIG_BATCH: {
+            auto *payload = (tcfg_client::cfg_batch_req_pkt *)(buf + sizeof(tcfg_client::header));
+            if (header->len < sizeof(tcfg_client::cfg_batch_req_pkt) + payload->count * sizeof(tcfg_client::cfg_key)) {
+                send_nack(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+
+            get_cfg_batch(payload->keys, payload->count);
+            break;
+        }
+
         case PKT_SET_CONFIG: {
             auto *payload = (tcfg_client::cfg_pkt *)(buf + sizeof(tcfg_client::header));
+            if (header->len < sizeof(tcfg_client::cfg_pkt) + payload->val_len) {
+                send_nack(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+
+            if (!cfg_names_valid(payload->ns, payload->key)) {
+                send_nack(ESP_ERR_INVALID_ARG);
+                break;
+            }
+
             set_cfg_to_nvs(payload->ns, payload->key, payload->type, payload->value, payload->val_len);
             break;
         }
 
+        case PKT_SET_CONFIG_BATCH: {
+            auto *payload = (tcfg_client::cfg_set_batch_req_pkt *)(buf + sizeof(tcfg_client::header));
+            set_cfg_batch(payload->records, header->len - sizeof(tcfg_client::cfg_set_batch_req_pkt), payload->count);
+            break;
+        }
+
+        case PKT_LIST_CONFIG: {
+            auto *payload = (tcfg_client::list_cfg_req_pkt *)(buf + sizeof(tcfg_client::header));
+            char ns[sizeof(tcfg_client::list_cfg_req_pkt::ns) + 1] = { 0 };
+            if (header->len >= sizeof(tcfg_client::list_cfg_req_pkt)) {
+                memcpy(ns, payload->ns, sizeof(payload->ns));
+            }
+
+            list_cfg(ns[0] == '\0' ? nullptr : ns);
+            break;
+        }
+
+        case PKT_EXPORT_CONFIG: {
+            export_cfg_snapshot();
+            break;
+        }
+
+        case PKT_IMPORT_CONFIG_BEGIN: {
+            auto *payload = (tcfg_client::cfg_import_begin_pkt *)(buf + sizeof(tcfg_client::header));
+            handle_import_begin(payload->len);
+            break;
+        }
+
+        case PKT_IMPORT_CONFIG_CHUNK: {
+            auto *payload = (tcfg_client::stream_chunk_pkt *)(buf + sizeof(tcfg_client::header));
+            handle_import_chunk(payload->offset, payload->data, header->len - sizeof(tcfg_client::stream_chunk_pkt));
+            break;
+        }
+
         case PKT_DEL_CONFIG: {
             auto *payload = (tcfg_client::del_cfg_pkt *)(buf + sizeof(tcfg_client::header));
+            if (!cfg_names_valid(payload->ns, payload->key)) {
+                send_nack(ESP_ERR_INVALID_ARG);
+                break;
+            }
+
             delete_cfg(payload->ns, payload->key);
             break;
         }
 
         case PKT_NUKE_CONFIG: {
             auto *payload = (tcfg_client::del_cfg_pkt *)(buf + sizeof(tcfg_client::header));
+            if (memchr(payload->ns, '\0', sizeof(payload->ns)) == nullptr) {
+                send_nack(ESP_ERR_INVALID_ARG);
+                break;
+            }
+
             nuke_cfg(payload->ns);
             break;
         }
@@ -156,13 +492,16 @@ void tcfg_client::handle_rx_pkt(const uint8_t *buf, size_t decoded_len)
         }
 
         case PKT_GET_UPTIME: {
-            auto *pkt = (tcfg_client::uptime_req_pkt *)(buf + sizeof(tcfg_client::header));
-            handle_uptime(pkt->realtime_ms);
+            tcfg_client::uptime_req_pkt pkt = {}; // Without a payload the clock is left alone
+            memcpy(&pkt, buf + sizeof(tcfg_client::header), std::min<size_t>(sizeof(pkt), header->len));
+            handle_uptime(pkt.realtime_ms);
             break;
         }
 
         case PKT_REBOOT: {
             ESP_LOGW(TAG, "Reboot requested!");
+            flush_nvs_cache();
+            flush_hash_cache();
             send_ack();
             vTaskDelay(pdMS_TO_TICKS(3500)); // Wait for a while to get the ACK sent...
             esp_restart();
@@ -171,6 +510,8 @@ void tcfg_client::handle_rx_pkt(const uint8_t *buf, size_t decoded_len)
 
         case PKT_REBOOT_BOOTLOADER: {
             ESP_LOGW(TAG, "Reboot to BL requested!");
+            flush_nvs_cache();
+            flush_hash_cache();
             send_ack();
             vTaskDelay(pdMS_TO_TICKS(3500)); // Wait for a while to get the ACK sent...
             REG_WRITE(RTC_CNTL_OPTION1_REG, RTC_CNTL_FORCE_DOWNLOAD_BOOT);
@@ -179,8 +520,18 @@ void tcfg_client::handle_rx_pkt(const uint8_t *buf, size_t decoded_len)
         }
 
         case PKT_BEGIN_FILE_WRITE: {
-            auto *payload = (tcfg_client::path_pkt *)(buf + sizeof(tcfg_client::header));
-            handle_begin_file_write(payload->path, payload->len);
+            tcfg_client::path_pkt req = {};
+            if (!read_path_pkt(buf + sizeof(tcfg_client::header), header->len, &req)) {
+                send_nack(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+
+            tcfg_client::file_write_opts opts = {};
+            if (header->len > sizeof(tcfg_client::path_pkt)) {
+                memcpy(&opts, buf + sizeof(tcfg_client::header) + sizeof(tcfg_client::path_pkt), std::min(sizeof(opts), header->len - sizeof(tcfg_client::path_pkt)));
+            }
+
+            handle_begin_file_write(req.path, req.len, opts);
             break;
         }
 
@@ -190,20 +541,83 @@ void tcfg_client::handle_rx_pkt(const uint8_t *buf, size_t decoded_len)
             break;
         }
 
+        case PKT_FILE_CHUNK_AT: {
+            auto *payload = (tcfg_client::file_chunk_pkt *)(buf + sizeof(tcfg_client::header));
+            handle_file_chunk_at(0, payload->offset, payload->data, header->len - sizeof(tcfg_client::file_chunk_pkt));
+            break;
+        }
+
+        case PKT_FILE_SESSION_CHUNK: {
+            auto *payload = (tcfg_client::session_chunk_pkt *)(buf + sizeof(tcfg_client::header));
+            handle_file_chunk_at(payload->session, payload->offset, payload->data, header->len - sizeof(tcfg_client::session_chunk_pkt));
+            break;
+        }
+
+        case PKT_FILE_READ: {
+            auto *payload = (tcfg_client::file_read_req_pkt *)(buf + sizeof(tcfg_client::header));
+            if (memchr(payload->path, '\0', sizeof(payload->path)) == nullptr) {
+                send_nack(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+
+            handle_file_read(payload->path, payload->offset, payload->len);
+            break;
+        }
+
+        case PKT_GET_FILE_SIG: {
+            auto *payload = (tcfg_client::file_sig_req_pkt *)(buf + sizeof(tcfg_client::header));
+            if (memchr(payload->path, '\0', sizeof(payload->path)) == nullptr) {
+                send_nack(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+
+            handle_get_file_sig(payload->path, payload->block_size);
+            break;
+        }
+
+        case PKT_BEGIN_FILE_PATCH: {
+            auto *payload = (tcfg_client::file_patch_begin_pkt *)(buf + sizeof(tcfg_client::header));
+            if (memchr(payload->path, '\0', sizeof(payload->path)) == nullptr) {
+                send_nack(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+
+            handle_begin_file_patch(*payload);
+            break;
+        }
+
+        case PKT_FILE_PATCH_CHUNK: {
+            auto *payload = (tcfg_client::stream_chunk_pkt *)(buf + sizeof(tcfg_client::header));
+            handle_file_patch_chunk(payload->offset, payload->flags, payload->data, header->len - sizeof(tcfg_client::stream_chunk_pkt));
+            break;
+        }
+
         case PKT_DELETE_FILE: {
-            auto *payload = (tcfg_client::path_pkt *)(buf + sizeof(tcfg_client::header));
-            handle_file_delete(payload->path);
+            tcfg_client::path_pkt req = {};
+            if (!read_path_pkt(buf + sizeof(tcfg_client::header), header->len, &req)) {
+                send_nack(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+
+            handle_file_delete(req.path);
             break;
         }
 
         case PKT_GET_FILE_INFO: {
-            auto *payload = (tcfg_client::path_pkt *)(buf + sizeof(tcfg_client::header));
-            handle_get_file_info(payload->path);
+            tcfg_client::path_pkt req = {};
+            if (!read_path_pkt(buf + sizeof(tcfg_client::header), header->len, &req)) {
+                send_nack(ESP_ERR_INVALID_SIZE);
+                break;
+            }
+
+            handle_get_file_info(req.path);
             break;
         }
 
         case PKT_BEGIN_OTA: {
-            handle_ota_begin();
+            tcfg_client::ota_begin_opts opts = {};
+            memcpy(&opts, buf + sizeof(tcfg_client::header), std::min<size_t>(sizeof(opts), header->len));
+            handle_ota_begin(opts);
             break;
         }
 
@@ -260,8 +674,8 @@ esp_err_t tcfg_client::send_pkt(tcfg_client::pkt_type type, const uint8_t *buf,
 
 esp_err_t tcfg_client::encode_and_tx(const uint8_t *header_buf, size_t header_len, const uint8_t *buf, size_t len, uint32_t timeout_ticks)
 {
-    ESP_LOGD(TAG, "EncodeAndTx: len=%u + %u", header_len, len);
-    if (!wire_if->write_response(header_buf, header_len, buf, len, timeout_ticks)) {
+    ESP_LOGD(TAG, "EncodeAndTx: len=%zu + %zu", header_len, len);
+    if (!curr_wire->write_response(header_buf, header_len, buf, len, timeout_ticks)) {
         ESP_LOGE(TAG, "Write failed");
         return ESP_FAIL;
     }
@@ -284,7 +698,10 @@ esp_err_t tcfg_client::send_nack(int32_t ret, uint32_t timeout_ticks)
 
 esp_err_t tcfg_client::send_dev_info(uint32_t timeout_ticks)
 {
-    return send_pkt(PKT_DEV_INFO, (uint8_t *)&dev_info, sizeof(dev_info), timeout_ticks);
+    // Wires may differ in frame size, so report the one asking
+    tcfg_client::device_info_pkt info = dev_info;
+    info.max_pkt_size = curr_wire->max_packet_size();
+    return send_pkt(PKT_DEV_INFO, (uint8_t *)&info, sizeof(info), timeout_ticks);
 }
 
 esp_err_t tcfg_client::send_chunk_ack(tcfg_client::chunk_state state, uint32_t aux, uint32_t timeout_ticks)
@@ -303,111 +720,134 @@ esp_err_t tcfg_client::set_cfg_to_nvs(const char *ns, const char *key, nvs_type_
     }
 
     esp_err_t ret = ESP_OK;
-    auto nv = nvs::open_nvs_handle(ns, NVS_READWRITE, &ret);
-    if (!nv || ret != ESP_OK) {
+    auto *nv = get_nvs_handle(ns, true, &ret);
+    if (nv == nullptr || ret != ESP_OK) {
         ESP_LOGE(TAG, "SetCfg: failed to set cfg, ret=%s", esp_err_to_name(ret));
         send_nack(ret);
         return ret;
     }
 
+    ret = write_cfg_value(*nv, key, type, value, value_len);
+    ret = ret ?: nv->commit();
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "SetCfg: %s:%s set OK", ns, key);
+        send_ack();
+    } else {
+        ESP_LOGE(TAG, "SetCfg: %s:%s set fail: %d %s", ns, key, ret, esp_err_to_name(ret));
+        send_nack(ret);
+    }
+
+    return ret;
+}
+
+esp_err_t tcfg_client::write_cfg_value(nvs::NVSHandle &nv, const char *key, nvs_type_t type, const void *value, size_t value_len)
+{
+    esp_err_t ret = ESP_OK;
+
     switch (type) {
         case NVS_TYPE_U8: {
             uint8_t val = 0;
-            memcpy(&val, value, sizeof(val));
-            ret = ret ?: nv->set_item(key, val);
+            if (sizeof(val) < value_len) {
+                ESP_LOGE(TAG, "SetCfg: unexpected length: %zu < %zu", sizeof(val), value_len);
+                return ESP_ERR_INVALID_SIZE;
+            }
+
+            memcpy(&val, value, std::min(sizeof(val), value_len));
+            ret = nv.set_item(key, val);
             break;
         }
 
         case NVS_TYPE_I8: {
             int8_t val = 0;
             if (sizeof(val) < value_len) {
-                ESP_LOGE(TAG, "SetCfg: unexpected length: %u < %u", sizeof(val), value_len);
+                ESP_LOGE(TAG, "SetCfg: unexpected length: %zu < %zu", sizeof(val), value_len);
                 return ESP_ERR_INVALID_SIZE;
             }
 
-            memcpy(&val, value, sizeof(val));
-            ret = ret ?: nv->set_item(key, val);
+            memcpy(&val, value, std::min(sizeof(val), value_len));
+            ret = nv.set_item(key, val);
             break;
         }
 
         case NVS_TYPE_U16: {
             uint16_t val = 0;
             if (sizeof(val) < value_len) {
-                ESP_LOGE(TAG, "SetCfg: unexpected length: %u < %u", sizeof(val), value_len);
+                ESP_LOGE(TAG, "SetCfg: unexpected length: %zu < %zu", sizeof(val), value_len);
                 return ESP_ERR_INVALID_SIZE;
             }
 
-            memcpy(&val, value, sizeof(val));
-            ret = ret ?: nv->set_item(key, val);
+            memcpy(&val, value, std::min(sizeof(val), value_len));
+            ret = nv.set_item(key, val);
             break;
         }
 
         case NVS_TYPE_I16: {
             int16_t val = 0;
             if (sizeof(val) < value_len) {
-                ESP_LOGE(TAG, "SetCfg: unexpected length: %u < %u", sizeof(val), value_len);
+                ESP_LOGE(TAG, "SetCfg: unexpected length: %zu < %zu", sizeof(val), value_len);
                 return ESP_ERR_INVALID_SIZE;
             }
 
-            memcpy(&val, value, sizeof(val));
-            ret = ret ?: nv->set_item(key, val);
+            memcpy(&val, value, std::min(sizeof(val), value_len));
+            ret = nv.set_item(key, val);
             break;
         }
 
         case NVS_TYPE_U32: {
             uint32_t val = 0;
             if (sizeof(val) < value_len) {
-                ESP_LOGE(TAG, "SetCfg: unexpected length: %u < %u", sizeof(val), value_len);
+                ESP_LOGE(TAG, "SetCfg: unexpected length: %zu < %zu", sizeof(val), value_len);
                 return ESP_ERR_INVALID_SIZE;
             }
 
-            memcpy(&val, value, sizeof(val));
-            ret = ret ?: nv->set_item(key, val);
+            memcpy(&val, value, std::min(sizeof(val), value_len));
+            ret = nv.set_item(key, val);
             break;
         }
 
         case NVS_TYPE_I32: {
             int32_t val = 0;
             if (sizeof(val) < value_len) {
-                ESP_LOGE(TAG, "SetCfg: unexpected length: %u < %u", sizeof(val), value_len);
+                ESP_LOGE(TAG, "SetCfg: unexpected length: %zu < %zu", sizeof(val), value_len);
                 return ESP_ERR_INVALID_SIZE;
             }
 
-            memcpy(&val, value, sizeof(val));
-            ret = ret ?: nv->set_item(key, val);
+            memcpy(&val, value, std::min(sizeof(val), value_len));
+            ret = nv.set_item(key, val);
             break;
         }
 
         case NVS_TYPE_U64: {
             uint64_t val = 0;
             if (sizeof(val) < value_len) {
-                ESP_LOGE(TAG, "SetCfg: unexpected length: %u < %u", sizeof(val), value_len);
+                ESP_LOGE(TAG, "SetCfg: unexpected length: %zu < %zu", sizeof(val), value_len);
                 return ESP_ERR_INVALID_SIZE;
             }
 
-            memcpy(&val, value, sizeof(val));
-            ret = ret ?: nv->set_item(key, val);
+            memcpy(&val, value, std::min(sizeof(val), value_len));
+            ret = nv.set_item(key, val);
             break;
         }
+
         case NVS_TYPE_I64: {
             int64_t val = 0;
             if (sizeof(val) < value_len) {
-                ESP_LOGE(TAG, "SetCfg: unexpected length: %u < %u", sizeof(val), value_len);
+                ESP_LOGE(TAG, "SetCfg: unexpected length: %zu < %zu", sizeof(val), value_len);
                 return ESP_ERR_INVALID_SIZE;
             }
 
-            memcpy(&val, value, sizeof(val));
-            ret = ret ?: nv->set_item(key, val);
+            memcpy(&val, value, std::min(sizeof(val), value_len));
+            ret = nv.set_item(key, val);
             break;
         }
 
         case NVS_TYPE_STR: {
-            if (value == nullptr) {
+            if (value == nullptr || memchr(value, '\0', value_len) == nullptr) {
                 ret = ESP_ERR_INVALID_ARG;
                 break;
             }
 
-            ret = ret ?: nv->set_string(key, (const char *)value);
+            ret = nv.set_string(key, (const char *)value);
             break;
         }
 
@@ -417,119 +857,244 @@ esp_err_t tcfg_client::set_cfg_to_nvs(const char *ns, const char *key, nvs_type_
                 break;
             }
 
-            ret = ret ?: nv->set_blob(key, value, value_len);
+            ret = nv.set_blob(key, value, value_len);
             break;
         }
 
-        case NVS_TYPE_ANY: {
+        default: {
             ret = ESP_ERR_INVALID_ARG;
+            break;
         }
     }
 
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "SetCfg: %s:%s set OK", ns, key);
-        send_ack();
-    } else {
-        ESP_LOGE(TAG, "SetCfg: %s:%s set fail: %d %s", ns, key, ret, esp_err_to_name(ret));
-        send_nack(ret);
-    }
-
     return ret;
 }
 
-esp_err_t tcfg_client::get_cfg_from_nvs(const char *ns, const char *key, nvs_type_t type)
+const tcfg_client::cfg_pkt *tcfg_client::next_cfg_record(const uint8_t *buf, size_t len, size_t *pos)
 {
-    if (ns == nullptr || key == nullptr) {
-        return ESP_ERR_INVALID_ARG;
+    if (*pos + sizeof(tcfg_client::cfg_pkt) > len) {
+        return nullptr;
     }
 
-    esp_err_t ret = ESP_OK;
-    auto nv = nvs::open_nvs_handle(ns, NVS_READONLY, &ret);
-    if (!nv || ret != ESP_OK) {
-        ESP_LOGE(TAG, "SetCfg: failed to set cfg, ret=%s", esp_err_to_name(ret));
-        send_nack(ret);
-        return ret;
+    auto *rec = (const tcfg_client::cfg_pkt *)(buf + *pos);
+    if (*pos + sizeof(tcfg_client::cfg_pkt) + rec->val_len > len) {
+        return nullptr;
     }
 
-    uint8_t tx_buf[TCFG_WIRE_MAX_PACKET_SIZE] = { 0 };
-    auto *pkt = (tcfg_client::cfg_pkt *)tx_buf;
-
-    memcpy(pkt->ns, ns, strnlen(ns, 16));
-    memcpy(pkt->key, key, strnlen(key, 16));
+    *pos += sizeof(tcfg_client::cfg_pkt) + rec->val_len;
+    return rec;
+}
 
-    switch (type) {
-        case NVS_TYPE_U8: {
-            uint8_t val = 0;
-            ret = ret ?: nv->get_item(key, val);
-            pkt->val_len = sizeof(uint8_t);
-            memcpy(pkt->value, &val, sizeof(uint8_t));
-            break;
-        }
-        case NVS_TYPE_I8: {
-            int8_t val = 0;
-            ret = ret ?: nv->get_item(key, val);
-            pkt->val_len = sizeof(int8_t);
-            memcpy(pkt->value, &val, sizeof(int8_t));
-            break;
+esp_err_t tcfg_client::apply_cfg_records(const uint8_t *buf, size_t len, uint16_t count, uint16_t *fail_idx_out)
+{
+    *fail_idx_out = UINT16_MAX;
+
+    // Check everything before writing anything, so a malformed batch leaves NVS untouched. This is validation, not a
+    // transaction: NVS can't roll back, so a write failing below leaves the records before it applied.
+    size_t pos = 0;
+    for (uint16_t idx = 0; idx < count; idx += 1) {
+        auto *rec = next_cfg_record(buf, len, &pos);
+        if (rec == nullptr) {
+            *fail_idx_out = idx;
+            return ESP_ERR_INVALID_SIZE;
         }
-        case NVS_TYPE_U16: {
-            uint16_t val = 0;
-            ret = ret ?: nv->get_item(key, val);
-            pkt->val_len = sizeof(uint16_t);
-            memcpy(pkt->value, &val, sizeof(uint16_t));
-            break;
+
+        bool valid = cfg_names_valid(rec->ns, rec->key);
+        switch (rec->type) {
+            case NVS_TYPE_U8:
+            case NVS_TYPE_I8:
+            case NVS_TYPE_U16:
+            case NVS_TYPE_I16:
+            case NVS_TYPE_U32:
+            case NVS_TYPE_I32:
+            case NVS_TYPE_U64:
+            case NVS_TYPE_I64: {
+                valid = valid && rec->val_len == (rec->type & 0x0f); // Low nibble of the integer types is their width
+                break;
+            }
+
+            case NVS_TYPE_STR: {
+                valid = valid && rec->val_len > 0 && memchr(rec->value, '\0', rec->val_len) != nullptr;
+                break;
+            }
+
+            case NVS_TYPE_BLOB: {
+                valid = valid && rec->val_len > 0;
+                break;
+            }
+
+            default: {
+                valid = false;
+                break;
+            }
+        }
+
+        if (!valid) {
+            ESP_LOGE(TAG, "ApplyCfg: record %u is malformed", idx);
+            *fail_idx_out = idx;
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    esp_err_t ret = ESP_OK;
+    pos = 0;
+    for (uint16_t idx = 0; idx < count; idx += 1) {
+        auto *rec = next_cfg_record(buf, len, &pos);
+        auto *nv = get_nvs_handle(rec->ns, true, &ret);
+        if (nv != nullptr && ret == ESP_OK) {
+            ret = write_cfg_value(*nv, rec->key, rec->type, rec->value, rec->val_len);
+        }
+
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "ApplyCfg: %s:%s failed: %d %s", rec->ns, rec->key, ret, esp_err_to_name(ret));
+            *fail_idx_out = idx;
+            break;
+        }
+    }
+
+    // One commit per namespace at the end; commits on handles the batch didn't touch are no-ops
+    esp_err_t commit_ret = commit_nvs_cache();
+    return ret ?: commit_ret;
+}
+
+esp_err_t tcfg_client::set_cfg_batch(const uint8_t *buf, size_t len, uint16_t count)
+{
+    uint16_t fail_idx = UINT16_MAX;
+    auto ret = apply_cfg_records(buf, len, count, &fail_idx);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "SetCfgBatch: failed at %u of %u: %d %s", fail_idx, count, ret, esp_err_to_name(ret));
+    } else {
+        ESP_LOGI(TAG, "SetCfgBatch: %u keys set OK", count);
+    }
+
+    tcfg_client::cfg_batch_status_pkt pkt = {};
+    pkt.ret = ret;
+    pkt.fail_idx = fail_idx;
+    return send_pkt(PKT_CONFIG_BATCH_STATUS, (uint8_t *)&pkt, sizeof(pkt));
+}
+
+esp_err_t tcfg_client::get_cfg_from_nvs(const char *ns, const char *key, nvs_type_t type)
+{
+    if (ns == nullptr || key == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    auto *nv = get_nvs_handle(ns, false, &ret);
+    if (nv == nullptr || ret != ESP_OK) {
+        ESP_LOGE(TAG, "GetCfg: failed to open ns %s, ret=%s", ns, esp_err_to_name(ret));
+        send_nack(ret);
+        return ret;
+    }
+
+    auto *tx_buf = pkt_pool.borrow();
+    if (tx_buf == nullptr) {
+        ESP_LOGE(TAG, "GetCfg: no free packet buffer");
+        return send_nack(ESP_ERR_NO_MEM);
+    }
+
+    auto *pkt = (tcfg_client::cfg_pkt *)tx_buf;
+    memset(pkt, 0, sizeof(tcfg_client::cfg_pkt));
+    memcpy(pkt->ns, ns, strnlen(ns, 16));
+    memcpy(pkt->key, key, strnlen(key, 16));
+    pkt->type = type;
+
+    uint16_t val_len = 0;
+    ret = read_cfg_value(*nv, key, type, pkt->value, PKT_BUF_SIZE - sizeof(tcfg_client::cfg_pkt), &val_len);
+    pkt->val_len = val_len;
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "GetConfig: can't read config, ret=%d %s", ret, esp_err_to_name(ret));
+        send_nack(ret);
+    } else {
+        size_t tx_len = sizeof(tcfg_client::cfg_pkt) + pkt->val_len;
+        ESP_LOGI(TAG, "GetConfig: send cfg %s:%s len=%zu", ns, key, tx_len);
+        ret = send_pkt(PKT_CONFIG_RESULT, tx_buf, tx_len);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "GetConfig: can't send config, ret=%d %s", ret, esp_err_to_name(ret));
+        }
+    }
+
+    pkt_pool.give_back(tx_buf);
+    return ret;
+}
+
+esp_err_t tcfg_client::read_cfg_value(nvs::NVSHandle &nv, const char *key, nvs_type_t type, uint8_t *val_out, size_t val_cap, uint16_t *val_len_out)
+{
+    esp_err_t ret = ESP_OK;
+    size_t len = 0;
+
+    switch (type) {
+        case NVS_TYPE_U8: {
+            uint8_t val = 0;
+            len = sizeof(val);
+            ret = len > val_cap ? ESP_ERR_INVALID_SIZE : nv.get_item(key, val);
+            memcpy(val_out, &val, std::min(len, val_cap));
+            break;
+        }
+        case NVS_TYPE_I8: {
+            int8_t val = 0;
+            len = sizeof(val);
+            ret = len > val_cap ? ESP_ERR_INVALID_SIZE : nv.get_item(key, val);
+            memcpy(val_out, &val, std::min(len, val_cap));
+            break;
+        }
+        case NVS_TYPE_U16: {
+            uint16_t val = 0;
+            len = sizeof(val);
+            ret = len > val_cap ? ESP_ERR_INVALID_SIZE : nv.get_item(key, val);
+            memcpy(val_out, &val, std::min(len, val_cap));
+            break;
         }
         case NVS_TYPE_I16: {
             int16_t val = 0;
-            ret = ret ?: nv->get_item(key, val);
-            pkt->val_len = sizeof(int16_t);
-            memcpy(pkt->value, &val, sizeof(int16_t));
+            len = sizeof(val);
+            ret = len > val_cap ? ESP_ERR_INVALID_SIZE : nv.get_item(key, val);
+            memcpy(val_out, &val, std::min(len, val_cap));
             break;
         }
         case NVS_TYPE_U32: {
             uint32_t val = 0;
-            ret = ret ?: nv->get_item(key, val);
-            pkt->val_len = sizeof(uint32_t);
-            memcpy(pkt->value, &val, sizeof(uint32_t));
+            len = sizeof(val);
+            ret = len > val_cap ? ESP_ERR_INVALID_SIZE : nv.get_item(key, val);
+            memcpy(val_out, &val, std::min(len, val_cap));
             break;
         }
         case NVS_TYPE_I32: {
             int32_t val = 0;
-            ret = ret ?: nv->get_item(key, val);
-            pkt->val_len = sizeof(int32_t);
-            memcpy(pkt->value, &val, sizeof(int32_t));
+            len = sizeof(val);
+            ret = len > val_cap ? ESP_ERR_INVALID_SIZE : nv.get_item(key, val);
+            memcpy(val_out, &val, std::min(len, val_cap));
             break;
         }
 
         case NVS_TYPE_U64: {
             uint64_t val = 0;
-            ret = ret ?: nv->get_item(key, val);
-            pkt->val_len = sizeof(uint64_t);
-            memcpy(pkt->value, &val, sizeof(uint64_t));
+            len = sizeof(val);
+            ret = len > val_cap ? ESP_ERR_INVALID_SIZE : nv.get_item(key, val);
+            memcpy(val_out, &val, std::min(len, val_cap));
             break;
         }
 
         case NVS_TYPE_I64: {
             int64_t val = 0;
-            ret = ret ?: nv->get_item(key, val);
-            pkt->val_len = sizeof(int64_t);
-            memcpy(pkt->value, &val, sizeof(int64_t));
+            len = sizeof(val);
+            ret = len > val_cap ? ESP_ERR_INVALID_SIZE : nv.get_item(key, val);
+            memcpy(val_out, &val, std::min(len, val_cap));
             break;
         }
 
         case NVS_TYPE_STR: {
-            size_t len = 0;
-            ret = nv->get_item_size((nvs::ItemType)type, key, len);
-            ret = ret ?: nv->get_string(key, (char *)pkt->value, len);
-            pkt->val_len = len;
+            ret = nv.get_item_size((nvs::ItemType)type, key, len);
+            ret = ret ?: (len > val_cap ? ESP_ERR_INVALID_SIZE : ESP_OK);
+            ret = ret ?: nv.get_string(key, (char *)val_out, len);
             break;
         }
 
         case NVS_TYPE_BLOB: {
-            size_t len = 0;
-            ret = nv->get_item_size((nvs::ItemType)type, key, len);
-            ret = ret ?: nv->get_blob(key, (void *)pkt->value, len);
-            pkt->val_len = len;
+            ret = nv.get_item_size((nvs::ItemType)type, key, len);
+            ret = ret ?: (len > val_cap ? ESP_ERR_INVALID_SIZE : ESP_OK);
+            ret = ret ?: nv.get_blob(key, (void *)val_out, len);
             break;
         }
 
@@ -539,276 +1104,2013 @@ esp_err_t tcfg_client::get_cfg_from_nvs(const char *ns, const char *key, nvs_typ
         }
     }
 
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "GetConfig: can't read config, ret=%d %s", ret, esp_err_to_name(ret));
-        send_nack(ret);
-    } else {
-        size_t tx_len = sizeof(tcfg_client::cfg_pkt) + pkt->val_len;
-        ESP_LOGI(TAG, "GetConfig: send cfg %s:%s len=%u", ns, key, tx_len);
-        ret = send_pkt(PKT_CONFIG_RESULT, tx_buf, tx_len);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "GetConfig: can't send config, ret=%d %s", ret, esp_err_to_name(ret));
-        }
-    }
-
+    *val_len_out = ret == ESP_OK ? len : 0;
     return ret;
 }
 
-esp_err_t tcfg_client::delete_cfg(const char *ns, const char *key)
+esp_err_t tcfg_client::get_cfg_batch(const tcfg_client::cfg_key *keys, uint16_t count)
 {
-    esp_err_t ret = ESP_OK;
-    auto nv = nvs::open_nvs_handle(ns, NVS_READWRITE, &ret);
-    if (!nv || ret != ESP_OK) {
-        ESP_LOGE(TAG, "DeleteConfig: failed to delete cfg, ret=%s", esp_err_to_name(ret));
-        send_nack(ret);
-        return ret;
+    if (keys == nullptr || count > MAX_BATCH_KEYS) {
+        ESP_LOGE(TAG, "GetCfgBatch: too many keys: %u", count);
+        send_nack(ESP_ERR_INVALID_ARG);
+        return ESP_ERR_INVALID_ARG;
     }
 
-    ret = nv->erase_item(key);
-    ret = ret ?: nv->commit();
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "DeleteConfig: failed to delete cfg, ret=%s", esp_err_to_name(ret));
-        send_nack(ret);
-        return ret;
+    auto *tx_buf = pkt_pool.borrow();
+    if (tx_buf == nullptr) {
+        ESP_LOGE(TAG, "GetCfgBatch: no free packet buffer");
+        return send_nack(ESP_ERR_NO_MEM);
     }
 
-    return send_ack();
-}
+    auto *result = (tcfg_client::cfg_batch_result_pkt *)tx_buf;
+    size_t frame_cap = std::min(PKT_BUF_SIZE, curr_wire->max_packet_size() - sizeof(tcfg_client::header));
+    size_t tx_len = sizeof(tcfg_client::cfg_batch_result_pkt);
+    result->count = 0;
+    result->flags = 0;
 
-esp_err_t tcfg_client::nuke_cfg(const char *ns)
-{
     esp_err_t ret = ESP_OK;
-    auto nv = nvs::open_nvs_handle(ns, NVS_READWRITE, &ret);
-    if (!nv || ret != ESP_OK) {
-        ESP_LOGE(TAG, "NukeCfg: failed to nuke cfg namespace %s, ret=%s", ns, esp_err_to_name(ret));
-        send_nack(ret);
-        return ret;
+
+    // Look keys up grouped by namespace so each one is opened only once; entries carry their index, so order doesn't matter.
+    // Groups are found by rescanning the keys rather than sorting an index, count is small enough for that.
+    auto same_ns = [keys](uint16_t a, uint16_t b) {
+        return strncmp(keys[a].ns, keys[b].ns, sizeof(cfg_key::ns)) == 0;
+    };
+
+    for (uint16_t first = 0; first < count; first += 1) {
+        uint16_t prev = 0;
+        while (prev < first && !same_ns(prev, first)) {
+            prev += 1;
+        }
+
+        if (prev < first) {
+            continue; // Namespace already done with an earlier key
+        }
+
+        char ns[sizeof(cfg_key::ns) + 1] = { 0 };
+        memcpy(ns, keys[first].ns, sizeof(cfg_key::ns));
+        esp_err_t ns_ret = ESP_OK;
+        auto *nv = get_nvs_handle(ns, false, &ns_ret);
+        if (nv == nullptr && ns_ret == ESP_OK) {
+            ns_ret = ESP_FAIL;
+        }
+
+        for (uint16_t idx = first; idx < count; idx += 1) {
+            if (!same_ns(first, idx)) {
+                continue;
+            }
+
+            const auto &item = keys[idx];
+            char key[sizeof(cfg_key::key) + 1] = { 0 };
+            memcpy(key, item.key, sizeof(item.key));
+
+            while (true) {
+                auto *entry = (tcfg_client::cfg_batch_entry *)(tx_buf + tx_len);
+                auto *pkt = (tcfg_client::cfg_pkt *)(tx_buf + tx_len + sizeof(tcfg_client::cfg_batch_entry));
+                size_t entry_hdr_len = sizeof(tcfg_client::cfg_batch_entry) + sizeof(tcfg_client::cfg_pkt);
+                if (tx_len + entry_hdr_len > frame_cap) {
+                    ret = send_pkt(PKT_CONFIG_BATCH_RESULT, tx_buf, tx_len);
+                    result->count = 0;
+                    tx_len = sizeof(tcfg_client::cfg_batch_result_pkt);
+                    continue;
+                }
+
+                uint16_t val_len = 0;
+                esp_err_t item_ret = ns_ret;
+                if (item_ret == ESP_OK) {
+                    item_ret = read_cfg_value(*nv, key, item.type, pkt->value, frame_cap - tx_len - entry_hdr_len, &val_len);
+                }
+
+                // Didn't fit behind what's already in this frame, so send those and retry in an empty one
+                if (item_ret == ESP_ERR_INVALID_SIZE && result->count > 0) {
+                    ret = send_pkt(PKT_CONFIG_BATCH_RESULT, tx_buf, tx_len);
+                    result->count = 0;
+                    tx_len = sizeof(tcfg_client::cfg_batch_result_pkt);
+                    continue;
+                }
+
+                entry->idx = idx;
+                entry->ret = item_ret;
+                memcpy(pkt->ns, item.ns, sizeof(pkt->ns));
+                memcpy(pkt->key, item.key, sizeof(pkt->key));
+                pkt->type = item.type;
+                pkt->val_len = val_len;
+
+                tx_len += entry_hdr_len + val_len;
+                result->count += 1;
+                break;
+            }
+        }
     }
 
-    ret = nv->erase_all();
+    ESP_LOGI(TAG, "GetCfgBatch: %u keys", count);
+    result->flags = CFG_BATCH_LAST;
+    ret = send_pkt(PKT_CONFIG_BATCH_RESULT, tx_buf, tx_len) ?: ret;
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "NukeCfg: failed to nuke cfg, ret=%s", esp_err_to_name(ret));
-        send_nack(ret);
-        return ret;
+        ESP_LOGE(TAG, "GetCfgBatch: can't send result, ret=%d %s", ret, esp_err_to_name(ret));
     }
 
-    return send_ack();
+    pkt_pool.give_back(tx_buf);
+    return ret;
 }
 
-esp_err_t tcfg_client::handle_begin_file_write(const char *path, size_t expect_len)
+esp_err_t tcfg_client::list_cfg(const char *ns)
 {
-    if (path == nullptr || expect_len < 1) {
-        return ESP_ERR_INVALID_ARG;
+    auto *tx_buf = pkt_pool.borrow();
+    if (tx_buf == nullptr) {
+        ESP_LOGE(TAG, "ListCfg: no free packet buffer");
+        return send_nack(ESP_ERR_NO_MEM);
     }
 
-    file_expect_len = expect_len;
-    fp = fopen(path, "wb");
+    auto *list = (tcfg_client::cfg_list_pkt *)tx_buf;
+    memset(list, 0, sizeof(tcfg_client::cfg_list_pkt));
+    size_t frame_cap = std::min(PKT_BUF_SIZE, curr_wire->max_packet_size() - sizeof(tcfg_client::header));
+    size_t tx_len = sizeof(tcfg_client::cfg_list_pkt);
+    size_t total = 0;
+    esp_err_t ret = ESP_OK;
 
-    if (fp == nullptr) {
-        ESP_LOGE(TAG, "BeginFileWrite: fopen() failed!");
-        send_nack(-1);
-        return ESP_FAIL;
-    }
+    nvs_iterator_t it = nullptr;
+    auto iter_ret = nvs_entry_find(NVS_DEFAULT_PART_NAME, ns, NVS_TYPE_ANY, &it);
+    while (iter_ret == ESP_OK) {
+        nvs_entry_info_t info = {};
+        nvs_entry_info(it, &info);
+
+        esp_err_t read_ret = ESP_OK;
+        auto *nv = get_nvs_handle(info.namespace_name, false, &read_ret);
+        while (nv != nullptr && read_ret == ESP_OK) {
+            auto *pkt = (tcfg_client::cfg_pkt *)(tx_buf + tx_len);
+            uint16_t val_len = 0;
+            if (tx_len + sizeof(tcfg_client::cfg_pkt) <= frame_cap) {
+                read_ret = read_cfg_value(*nv, info.key, info.type, pkt->value, frame_cap - tx_len - sizeof(tcfg_client::cfg_pkt), &val_len);
+            } else {
+                read_ret = ESP_ERR_INVALID_SIZE;
+            }
 
-    return send_chunk_ack(chunk_state::CHUNK_XFER_NEXT, 0);
-}
+            if (read_ret == ESP_ERR_INVALID_SIZE && list->count > 0) {
+                ret = send_pkt(PKT_CONFIG_LIST, tx_buf, tx_len) ?: ret;
+                list->count = 0;
+                tx_len = sizeof(tcfg_client::cfg_list_pkt);
+                read_ret = ESP_OK;
+                continue;
+            }
 
-esp_err_t tcfg_client::handle_file_chunk(const uint8_t *buf, uint16_t len)
-{
-    if (fp == nullptr) {
-        ESP_LOGE(TAG, "FileChunk: not started yet!");
-        send_nack(ESP_ERR_INVALID_STATE);
-        return ESP_ERR_INVALID_STATE;
-    }
+            if (read_ret == ESP_OK) {
+                memset(pkt, 0, sizeof(tcfg_client::cfg_pkt));
+                snprintf(pkt->ns, sizeof(pkt->ns), "%s", info.namespace_name);
+                snprintf(pkt->key, sizeof(pkt->key), "%s", info.key);
+                pkt->type = info.type;
+                pkt->val_len = val_len;
+                tx_len += sizeof(tcfg_client::cfg_pkt) + val_len;
+                list->count += 1;
+                total += 1;
+            }
 
-    if (buf == nullptr || len == 0) {
-        ESP_LOGW(TAG, "FileChunk: abort requested");
-        send_chunk_ack(CHUNK_ERR_ABORT_REQUESTED);
-        fclose(fp);
-        fp = nullptr;
-        return ESP_OK;
-    }
+            break;
+        }
 
-    if (ftell(fp) > file_expect_len) {
-        ESP_LOGE(TAG, "FileChunk: file written more than it supposed to: %ld < %d", ftell(fp), file_expect_len);
-        send_chunk_ack(chunk_state::CHUNK_ERR_INTERNAL, ESP_ERR_INVALID_STATE);
-        fclose(fp);
-        fp = nullptr;
-        return ESP_ERR_INVALID_STATE;
-    }
+        if (read_ret != ESP_OK) {
+            ESP_LOGW(TAG, "ListCfg: skip %s:%s, ret=%d %s", info.namespace_name, info.key, read_ret, esp_err_to_name(read_ret));
+            list->skipped += 1;
+        }
 
-    auto ret_len = fwrite(buf, 1, len, fp);
-    if (ret_len < len) {
-        ESP_LOGE(TAG, "FileChunk: can't write in full! ret_len=%d < %d", ret_len, len);
-        send_chunk_ack(chunk_state::CHUNK_ERR_INTERNAL, ESP_ERR_INVALID_SIZE);
-        fclose(fp);
-        fp = nullptr;
-        return ESP_ERR_INVALID_SIZE;
+        iter_ret = nvs_entry_next(&it);
     }
 
-    if (ftell(fp) == file_expect_len) {
-        ESP_LOGI(TAG, "FileChunk: received %u OK", file_expect_len);
-        send_chunk_ack(chunk_state::CHUNK_XFER_DONE, ftell(fp));
-        fflush(fp);
-        fclose(fp);
-        fp = nullptr;
-        return ESP_OK;
+    nvs_release_iterator(it);
+    if (iter_ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "ListCfg: iterator failed, ret=%d %s", iter_ret, esp_err_to_name(iter_ret));
     }
 
-    send_chunk_ack(chunk_state::CHUNK_XFER_NEXT, ftell(fp));
-    return ESP_OK;
+    ESP_LOGI(TAG, "ListCfg: %u entries, %u skipped", (unsigned)total, list->skipped);
+    list->flags = STREAM_LAST;
+    ret = send_pkt(PKT_CONFIG_LIST, tx_buf, tx_len) ?: ret;
+    pkt_pool.give_back(tx_buf);
+    return ret;
 }
 
-esp_err_t tcfg_client::handle_file_delete(const char *path)
+esp_err_t tcfg_client::send_stream(tcfg_client::pkt_type type, const uint8_t *buf, size_t len)
 {
-    if (unlink(path) < 0) {
-        send_nack(ESP_FAIL);
+    auto *tx_buf = pkt_pool.borrow();
+    if (tx_buf == nullptr) {
+        ESP_LOGE(TAG, "SendStream: no free packet buffer");
+        return send_nack(ESP_ERR_NO_MEM);
     }
 
-    return send_ack();
+    auto *chunk = (tcfg_client::stream_chunk_pkt *)tx_buf;
+    size_t data_cap = std::min(PKT_BUF_SIZE, curr_wire->max_packet_size() - sizeof(tcfg_client::header)) - sizeof(tcfg_client::stream_chunk_pkt);
+
+    esp_err_t ret = ESP_OK;
+    size_t offset = 0;
+    do {
+        size_t chunk_len = std::min(data_cap, len - offset);
+        chunk->offset = offset;
+        chunk->flags = (offset + chunk_len >= len) ? STREAM_LAST : 0;
+        memcpy(chunk->data, buf + offset, chunk_len);
+
+        ret = send_pkt(type, tx_buf, sizeof(tcfg_client::stream_chunk_pkt) + chunk_len);
+        offset += chunk_len;
+    } while (ret == ESP_OK && offset < len);
+
+    pkt_pool.give_back(tx_buf);
+    return ret;
 }
 
-esp_err_t tcfg_client::handle_get_file_info(const char *path)
+esp_err_t tcfg_client::build_cfg_snapshot(uint8_t *buf, size_t cap, size_t *len_out)
 {
-    FILE *file_info_fp = fopen(path, "r");
-    if (file_info_fp == nullptr) {
-        ESP_LOGE(TAG, "GetFileInfo: Can't open");
-        send_nack(ESP_ERR_NOT_FOUND);
-        return ESP_ERR_NOT_FOUND;
+    if (cap < sizeof(tcfg_client::cfg_snapshot_hdr) + sizeof(tcfg_client::cfg_snapshot_trailer)) {
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    if (fseek(file_info_fp, 0, SEEK_END) < 0) {
-        ESP_LOGE(TAG, "GetFileInfo: Can't estimate length, errno %d", errno);
-        send_nack(ESP_FAIL);
-        return ESP_FAIL;
+    // The iterator walks pages, not namespaces - collect the names first so the image comes out grouped,
+    // which lets the importer get away with one open handle and one commit per namespace.
+    // The names are parked at the tail of `buf`, growing down, so this needs no allocation of its own.
+    using ns_name = char[sizeof(nvs_entry_info_t::namespace_name)];
+    size_t rec_cap = cap - sizeof(tcfg_client::cfg_snapshot_trailer);
+    auto *ns_end = (ns_name *)(buf + rec_cap);
+    auto *ns_begin = ns_end;
+    nvs_iterator_t it = nullptr;
+    auto iter_ret = nvs_entry_find(NVS_DEFAULT_PART_NAME, nullptr, NVS_TYPE_ANY, &it);
+    while (iter_ret == ESP_OK) {
+        nvs_entry_info_t info = {};
+        nvs_entry_info(it, &info);
+        auto *found = std::find_if(ns_begin, ns_end, [&info](const ns_name &name) {
+            return strncmp(name, info.namespace_name, sizeof(ns_name)) == 0;
+        });
+
+        if (found == ns_end) {
+            if ((size_t)((uint8_t *)ns_begin - buf) < sizeof(tcfg_client::cfg_snapshot_hdr) + sizeof(ns_name)) {
+                iter_ret = ESP_ERR_INVALID_SIZE;
+                break;
+            }
+
+            ns_begin -= 1;
+            memcpy(*ns_begin, info.namespace_name, sizeof(ns_name));
+        }
+
+        iter_ret = nvs_entry_next(&it);
     }
 
-    int32_t file_len = ftell(file_info_fp);
-    if (file_len < 0) {
-        ESP_LOGE(TAG, "GetFileInfo: Can't ftell() length");
-        send_nack(ESP_ERR_INVALID_SIZE);
-        return ESP_ERR_INVALID_SIZE;
+    nvs_release_iterator(it);
+    if (iter_ret != ESP_ERR_NVS_NOT_FOUND) {
+        return iter_ret;
     }
 
-    rewind(file_info_fp);
+    auto *hdr = (tcfg_client::cfg_snapshot_hdr *)buf;
+    memset(hdr, 0, sizeof(tcfg_client::cfg_snapshot_hdr));
+    hdr->magic = CFG_SNAPSHOT_MAGIC;
+    hdr->version = CFG_SNAPSHOT_VERSION;
 
-    if (file_len == 0) {
-        tcfg_client::file_info_pkt info_pkt = {};
-        info_pkt.size = 0;
+    size_t pos = sizeof(tcfg_client::cfg_snapshot_hdr);
+    esp_err_t ret = ESP_OK;
+    for (auto *ns = ns_begin; ns != ns_end; ns += 1) {
+        // Names still to do sit above this slot, so once it's copied the records may grow into it
+        ns_name ns_buf = {};
+        memcpy(ns_buf, *ns, sizeof(ns_buf));
+        rec_cap = (uint8_t *)(ns + 1) - buf;
+
+        auto *nv = get_nvs_handle(ns_buf, false, &ret);
+        if (nv == nullptr || ret != ESP_OK) {
+            return ret ?: ESP_FAIL;
+        }
 
-        ESP_LOGW(TAG, "GetFileInfo: file size 0, skip SHA256");
-        return send_pkt(PKT_FILE_INFO, (uint8_t *)&info_pkt, sizeof(info_pkt));
-    }
+        iter_ret = nvs_entry_find(NVS_DEFAULT_PART_NAME, ns_buf, NVS_TYPE_ANY, &it);
+        while (iter_ret == ESP_OK && ret == ESP_OK) {
+            nvs_entry_info_t info = {};
+            nvs_entry_info(it, &info);
+
+            auto *rec = (tcfg_client::cfg_pkt *)(buf + pos);
+            uint16_t val_len = 0;
+            if (pos + sizeof(tcfg_client::cfg_pkt) > rec_cap || hdr->count == UINT16_MAX) {
+                ret = ESP_ERR_INVALID_SIZE;
+            } else {
+                ret = read_cfg_value(*nv, info.key, info.type, rec->value, rec_cap - pos - sizeof(tcfg_client::cfg_pkt), &val_len);
+            }
 
-    mbedtls_sha256_context ctx;
-    mbedtls_sha256_init(&ctx);
-    mbedtls_sha256_starts(&ctx, /*is224=*/0);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Snapshot: can't add %s:%s, ret=%d %s", info.namespace_name, info.key, ret, esp_err_to_name(ret));
+                break;
+            }
 
-    uint8_t buf[256] = { 0 };
-    size_t read_len = 0;
-    while ((read_len = fread(buf, 1, sizeof(buf), file_info_fp)) > 0) {
-        mbedtls_sha256_update(&ctx, buf, read_len);
+            memset(rec, 0, sizeof(tcfg_client::cfg_pkt));
+            snprintf(rec->ns, sizeof(rec->ns), "%s", info.namespace_name);
+            snprintf(rec->key, sizeof(rec->key), "%s", info.key);
+            rec->type = info.type;
+            rec->val_len = val_len;
+            pos += sizeof(tcfg_client::cfg_pkt) + val_len;
+            hdr->count += 1;
+
+            iter_ret = nvs_entry_next(&it);
+        }
+
+        nvs_release_iterator(it);
+        if (ret != ESP_OK) {
+            return ret;
+        }
     }
 
-    fclose(file_info_fp);
+    auto *trailer = (tcfg_client::cfg_snapshot_trailer *)(buf + pos);
+    trailer->crc = esp_crc32_le(0, buf, pos);
+    *len_out = pos + sizeof(tcfg_client::cfg_snapshot_trailer);
+    return ESP_OK;
+}
 
-    tcfg_client::file_info_pkt info_pkt = {};
-    info_pkt.size = file_len;
-    if (mbedtls_sha256_finish(&ctx, info_pkt.hash) < 0) {
-        ESP_LOGE(TAG, "GetFileInfo: Can't finalise SHA256");
-        send_nack(ESP_FAIL);
-        return ESP_FAIL;
+esp_err_t tcfg_client::export_cfg_snapshot()
+{
+    auto *image = (uint8_t *)heap_caps_malloc(CONFIG_TC_CFG_SNAPSHOT_MAX_SIZE, MALLOC_CAP_SPIRAM);
+    if (image == nullptr) {
+        ESP_LOGE(TAG, "Snapshot: can't allocate image buffer");
+        return send_nack(ESP_ERR_NO_MEM);
     }
 
-    return send_pkt(PKT_FILE_INFO, (uint8_t *)&info_pkt, sizeof(info_pkt));
+    size_t len = 0;
+    auto ret = build_cfg_snapshot(image, CONFIG_TC_CFG_SNAPSHOT_MAX_SIZE, &len);
+    if (ret != ESP_OK) {
+        free(image);
+        send_nack(ret);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Snapshot: exporting %u keys, %zu bytes", ((tcfg_client::cfg_snapshot_hdr *)image)->count, len);
+    ret = send_stream(PKT_CONFIG_SNAPSHOT, image, len);
+    free(image);
+    return ret;
 }
 
-esp_err_t tcfg_client::handle_ota_begin()
+esp_err_t tcfg_client::handle_import_begin(size_t len)
 {
-    if (ota_handle != 0) {
-        ESP_LOGW(TAG, "OTA already started!");
-        send_nack(ESP_ERR_INVALID_STATE);
-        return ESP_ERR_INVALID_STATE;
-    } else {
-        curr_ota_part = esp_ota_get_next_update_partition(nullptr);
-        if (curr_ota_part == nullptr) {
-            ESP_LOGW(TAG, "OTA partition not present!");
-            send_nack(ESP_ERR_NOT_SUPPORTED);
-            return ESP_ERR_NOT_SUPPORTED;
-        }
+    if (len < sizeof(tcfg_client::cfg_snapshot_hdr) + sizeof(tcfg_client::cfg_snapshot_trailer) || len > CONFIG_TC_CFG_SNAPSHOT_MAX_SIZE) {
+        ESP_LOGE(TAG, "Import: bad image length %zu", len);
+        return send_nack(ESP_ERR_INVALID_SIZE);
+    }
 
-        auto ota_ret = esp_ota_begin(curr_ota_part, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
-        if (ota_ret != ESP_OK) {
-            ESP_LOGE(TAG, "OTA begin failed; ret=%d %s", ota_ret, esp_err_to_name(ota_ret));
-            send_nack(ota_ret);
-        } else {
-            ESP_LOGW(TAG, "OTA begin");
-        }
+    free(import_ctx.buf);
+    import_ctx = {};
+    import_ctx.buf = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    if (import_ctx.buf == nullptr) {
+        ESP_LOGE(TAG, "Import: can't allocate %zu bytes", len);
+        return send_nack(ESP_ERR_NO_MEM);
     }
 
-    return send_ack();
+    import_ctx.len = len;
+    return send_chunk_ack(CHUNK_XFER_NEXT, 0);
 }
 
-esp_err_t tcfg_client::handle_ota_chunk(const uint8_t *buf, uint16_t len)
+esp_err_t tcfg_client::handle_import_chunk(uint32_t offset, const uint8_t *buf, size_t len)
 {
-    if (ota_handle == 0) {
-        ESP_LOGE(TAG, "OTA not started yet!");
+    if (import_ctx.buf == nullptr) {
         return send_nack(ESP_ERR_INVALID_STATE);
     }
 
-    if (len == 0) {
-        ESP_LOGW(TAG, "OTA abort requested!");
-        auto ret = esp_ota_abort(ota_handle);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "OTA failed to abort! ret=%d %s", ret, esp_err_to_name(ret));
-            send_chunk_ack(CHUNK_ERR_INTERNAL, ret);
-            return ret;
-        }
+    if (offset != import_ctx.offset) {
+        // Lost or repeated chunk, tell the host where to carry on from
+        return send_chunk_ack(CHUNK_XFER_NEXT, import_ctx.offset);
+    }
 
-        curr_ota_chunk_offset += len;
-        ota_handle = 0;
-        return send_chunk_ack(CHUNK_ERR_ABORT_REQUESTED, curr_ota_chunk_offset);
+    if (len > import_ctx.len - import_ctx.offset) {
+        ESP_LOGE(TAG, "Import: chunk runs past the image end");
+        free(import_ctx.buf);
+        import_ctx = {};
+        return send_nack(ESP_ERR_INVALID_SIZE);
     }
 
-    auto ret = esp_ota_write(ota_handle, buf, len);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "OTA failed to write chunk! ret=%d %s", ret, esp_err_to_name(ret));
-        send_chunk_ack(CHUNK_ERR_INTERNAL, ret);
-        return ret;
+    memcpy(import_ctx.buf + import_ctx.offset, buf, len);
+    import_ctx.offset += len;
+    if (import_ctx.offset < import_ctx.len) {
+        return send_chunk_ack(CHUNK_XFER_NEXT, import_ctx.offset);
     }
 
-    curr_ota_chunk_offset += len;
-    return send_chunk_ack(CHUNK_XFER_NEXT, curr_ota_chunk_offset);
+    uint16_t fail_idx = UINT16_MAX;
+    auto ret = apply_cfg_snapshot(import_ctx.buf, import_ctx.len, &fail_idx);
+    free(import_ctx.buf);
+    import_ctx = {};
+
+    tcfg_client::cfg_batch_status_pkt pkt = {};
+    pkt.ret = ret;
+    pkt.fail_idx = fail_idx;
+    return send_pkt(PKT_CONFIG_BATCH_STATUS, (uint8_t *)&pkt, sizeof(pkt));
 }
 
-esp_err_t tcfg_client::handle_ota_commit()
+esp_err_t tcfg_client::apply_cfg_snapshot(const uint8_t *buf, size_t len, uint16_t *fail_idx_out)
 {
-    if (ota_handle == 0) {
-        ESP_LOGE(TAG, "OTA commit requested but not started!");
-        send_nack(ESP_ERR_INVALID_STATE);
+    *fail_idx_out = UINT16_MAX;
+
+    size_t body_len = len - sizeof(tcfg_client::cfg_snapshot_trailer);
+    auto *hdr = (const tcfg_client::cfg_snapshot_hdr *)buf;
+    auto *trailer = (const tcfg_client::cfg_snapshot_trailer *)(buf + body_len);
+    if (hdr->magic != CFG_SNAPSHOT_MAGIC || hdr->version != CFG_SNAPSHOT_VERSION) {
+        ESP_LOGE(TAG, "Import: bad magic 0x%" PRIx32 " or version %u", hdr->magic, hdr->version);
+        return ESP_ERR_INVALID_VERSION;
+    }
 
-        ota_handle = 0;
-        curr_ota_part = nullptr;
-        curr_ota_chunk_offset = 0;
-        return ESP_ERR_INVALID_STATE;
+    uint32_t crc = esp_crc32_le(0, buf, body_len);
+    if (crc != trailer->crc) {
+        ESP_LOGE(TAG, "Import: CRC mismatch, expect 0x%" PRIx32 ", actual 0x%" PRIx32, trailer->crc, crc);
+        return ESP_ERR_INVALID_CRC;
     }
 
-    auto ret = esp_ota_end(ota_handle);
-    ret = ret ?: esp_ota_set_boot_partition(curr_ota_part);
+    auto ret = apply_cfg_records(buf + sizeof(tcfg_client::cfg_snapshot_hdr), body_len - sizeof(tcfg_client::cfg_snapshot_hdr), hdr->count, fail_idx_out);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "OTA failed to end! ret=%d %s", ret, esp_err_to_name(ret));
-        send_nack(ret);
-
-        ota_handle = 0;
-        curr_ota_part = nullptr;
-        curr_ota_chunk_offset = 0;
-        return ret;
+        ESP_LOGE(TAG, "Import: failed at %u of %u: %d %s", *fail_idx_out, hdr->count, ret, esp_err_to_name(ret));
+    } else {
+        ESP_LOGI(TAG, "Import: %u keys applied", hdr->count);
     }
 
-    ota_handle = 0;
+    return ret;
+}
+
+esp_err_t tcfg_client::delete_cfg(const char *ns, const char *key)
+{
+    esp_err_t ret = ESP_OK;
+    auto *nv = get_nvs_handle(ns, false, &ret);
+    if (nv == nullptr || ret != ESP_OK) {
+        ESP_LOGE(TAG, "DeleteConfig: failed to delete cfg, ret=%s", esp_err_to_name(ret));
+        send_nack(ret);
+        return ret;
+    }
+
+    ret = nv->erase_item(key);
+    ret = ret ?: nv->commit();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "DeleteConfig: failed to delete cfg, ret=%s", esp_err_to_name(ret));
+        send_nack(ret);
+        return ret;
+    }
+
+    return send_ack();
+}
+
+esp_err_t tcfg_client::nuke_cfg(const char *ns)
+{
+    esp_err_t ret = ESP_OK;
+    auto *nv = get_nvs_handle(ns, false, &ret);
+    if (nv == nullptr || ret != ESP_OK) {
+        ESP_LOGE(TAG, "NukeCfg: failed to nuke cfg namespace %s, ret=%s", ns, esp_err_to_name(ret));
+        send_nack(ret);
+        return ret;
+    }
+
+    ret = nv->erase_all();
+    ret = ret ?: nv->commit();
+    evict_nvs_handle(ns);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "NukeCfg: failed to nuke cfg, ret=%s", esp_err_to_name(ret));
+        send_nack(ret);
+        return ret;
+    }
+
+    return send_ack();
+}
+
+nvs::NVSHandle *tcfg_client::get_nvs_handle(const char *ns, bool create, esp_err_t *ret_out)
+{
+    *ret_out = ESP_OK;
+    if (ns == nullptr) {
+        *ret_out = ESP_ERR_INVALID_ARG;
+        return nullptr;
+    }
+
+    nvs_cache_entry *victim = &nvs_cache[0];
+    for (auto &entry : nvs_cache) {
+        if (entry.handle && strncmp(entry.ns, ns, sizeof(entry.ns) - 1) == 0) {
+            entry.last_used = ++nvs_cache_tick;
+            nvs_stats.hits += 1;
+            return entry.handle.get();
+        }
+
+        if (!entry.handle) {
+            victim = &entry;
+        } else if (victim->handle && entry.last_used < victim->last_used) {
+            victim = &entry;
+        }
+    }
+
+    nvs_stats.misses += 1;
+
+    // Opening read-write creates the namespace, so readers check it exists first (only on a miss)
+    if (!create) {
+        nvs_handle_t probe = 0;
+        *ret_out = nvs_open(ns, NVS_READONLY, &probe);
+        if (*ret_out != ESP_OK) {
+            return nullptr;
+        }
+
+        nvs_close(probe);
+    }
+
+    auto handle = nvs::open_nvs_handle(ns, NVS_READWRITE, ret_out);
+    if (!handle || *ret_out != ESP_OK) {
+        *ret_out = *ret_out ?: ESP_FAIL;
+        return nullptr;
+    }
+
+    if (victim->handle) {
+        ESP_LOGD(TAG, "NvsCache: evict %s", victim->ns);
+        victim->handle->commit();
+        nvs_stats.evictions += 1;
+    }
+
+    snprintf(victim->ns, sizeof(victim->ns), "%.*s", (int)strnlen(ns, sizeof(victim->ns) - 1), ns);
+    victim->handle = std::move(handle);
+    victim->last_used = ++nvs_cache_tick;
+    return victim->handle.get();
+}
+
+void tcfg_client::evict_nvs_handle(const char *ns)
+{
+    for (auto &entry : nvs_cache) {
+        if (entry.handle && strncmp(entry.ns, ns, sizeof(entry.ns) - 1) == 0) {
+            entry.handle.reset();
+            entry.ns[0] = '\0';
+            nvs_stats.evictions += 1;
+        }
+    }
+}
+
+esp_err_t tcfg_client::commit_nvs_cache()
+{
+    esp_err_t ret = ESP_OK;
+    for (auto &entry : nvs_cache) {
+        if (entry.handle) {
+            ret = entry.handle->commit() ?: ret;
+        }
+    }
+
+    return ret;
+}
+
+esp_err_t tcfg_client::flush_nvs_cache()
+{
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    esp_err_t ret = commit_nvs_cache();
+    for (auto &entry : nvs_cache) {
+        entry.handle.reset();
+        entry.ns[0] = '\0';
+    }
+
+    xSemaphoreGive(cfg_lock);
+    return ret;
+}
+
+esp_err_t tcfg_client::flush_hash_cache()
+{
+    xSemaphoreTake(file_lock, portMAX_DELAY);
+    esp_err_t ret = hash_cache.flush();
+    xSemaphoreGive(file_lock);
+    return ret;
+}
+
+tcfg_client::nvs_cache_stats tcfg_client::get_nvs_cache_stats() const
+{
+    return nvs_stats;
+}
+
+tcfg_buf_pool::stats tcfg_client::get_pkt_pool_stats() const
+{
+    return pkt_pool.get_stats();
+}
+
+esp_err_t tcfg_client::handle_begin_file_write(const char *path, size_t expect_len, const tcfg_client::file_write_opts &opts)
+{
+    if (path == nullptr || expect_len < 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    tcfg_client::file_xfer *slot = find_file_xfer(opts.session);
+    for (auto &other : file_xfers) {
+        if (slot == nullptr && other.fp == nullptr) {
+            slot = &other;
+        }
+
+        if (other.fp != nullptr && other.session != opts.session && strcmp(path, other.path) == 0) {
+            ESP_LOGE(TAG, "BeginFileWrite: %s already being written by session %u", path, other.session);
+            return send_nack(ESP_ERR_INVALID_STATE);
+        }
+    }
+
+    if (slot == nullptr) {
+        ESP_LOGE(TAG, "BeginFileWrite: all %u sessions busy", CONFIG_TC_FILE_MAX_SESSIONS);
+        return send_nack(ESP_ERR_NO_MEM);
+    }
+
+    auto &xfer = *slot;
+    if (opts.xfer_id != 0 && xfer.fp != nullptr && opts.xfer_id == xfer.xfer_id && opts.encoding == xfer.encoding
+        && expect_len == xfer.expect_len && strcmp(path, xfer.path) == 0) {
+        // Same upload after the link dropped: everything acked is still in hand, the host only needs to know where to go on from
+        ESP_LOGI(TAG, "BeginFileWrite: %s (session %u) picked up again at %zu", path, xfer.session, xfer.stream_offset);
+        xfer.unacked = 0;
+        xfer.gap_acked = false;
+
+        tcfg_client::file_begin_ack_pkt pkt = {};
+        pkt.state = CHUNK_XFER_NEXT;
+        pkt.aux_info = xfer.stream_offset;
+        pkt.window = xfer.window;
+        return send_xfer_ack(xfer.session, &pkt, sizeof(pkt));
+    }
+
+    if (xfer.fp != nullptr) {
+        ESP_LOGW(TAG, "BeginFileWrite: previous upload in session %u not finished, closing it", xfer.session);
+        close_file_xfer(xfer);
+    }
+
+    if (opts.encoding != XFER_RAW && opts.encoding != XFER_DEFLATE) {
+        ESP_LOGE(TAG, "BeginFileWrite: unknown encoding %u", opts.encoding);
+        return send_nack(ESP_ERR_NOT_SUPPORTED);
+    }
+
+    hash_cache.invalidate(path);
+    xfer.session = opts.session;
+    snprintf(xfer.ckpt_key, sizeof(xfer.ckpt_key), "%s%u", XFER_KEY_FILE, opts.session);
+
+    // Only raw uploads can be checkpointed, an inflate window can't be brought back after a reboot
+    bool resumed = opts.xfer_id != 0 && opts.encoding == XFER_RAW && resume_file_xfer(xfer, path, expect_len, opts.xfer_id) == ESP_OK;
+    if (!resumed) {
+        xfer.fp = fopen(path, "wb");
+        if (xfer.fp == nullptr) {
+            ESP_LOGE(TAG, "BeginFileWrite: fopen() failed!");
+            send_nack(-1);
+            return ESP_FAIL;
+        }
+
+        mbedtls_sha256_init(&xfer.sha);
+        mbedtls_sha256_starts(&xfer.sha, /*is224=*/0);
+        xfer.offset = 0;
+    }
+
+    // Chunks get gathered into sector-aligned blocks here, so stdio's own small buffer would only add a copy
+    xfer.wb_buf = (uint8_t *)heap_caps_malloc(FILE_WB_SIZE, MALLOC_CAP_SPIRAM);
+    xfer.wb_len = 0;
+    if (xfer.wb_buf != nullptr) {
+        if (!resumed) { // resume_file_xfer() already turned buffering off before it read the file
+            setvbuf(xfer.fp, nullptr, _IONBF, 0);
+        }
+    } else {
+        ESP_LOGW(TAG, "BeginFileWrite: no write-behind buffer, writing chunks as they come");
+    }
+
+    if (opts.encoding == XFER_DEFLATE && !xfer.inflate.begin(CONFIG_TC_INFLATE_DICT_SIZE)) {
+        ESP_LOGE(TAG, "BeginFileWrite: can't allocate inflate state");
+        close_file_xfer(xfer);
+        return send_nack(ESP_ERR_NO_MEM);
+    }
+
+    // Reserve the space up front so the FS doesn't have to grow the file (and its FAT/metadata) block by block
+    if (ftruncate(fileno(xfer.fp), expect_len) != 0) {
+        ESP_LOGD(TAG, "BeginFileWrite: can't preallocate, errno %d", errno);
+    }
+
+    snprintf(xfer.path, sizeof(xfer.path), "%.*s", (int)strnlen(path, sizeof(xfer.path) - 1), path);
+    xfer.verify = (opts.flags & FILE_WRITE_VERIFY_SHA256) != 0;
+    memcpy(xfer.expect_hash, opts.hash, sizeof(xfer.expect_hash));
+    xfer.expect_len = expect_len;
+    xfer.stream_offset = xfer.offset;
+    xfer.encoding = opts.encoding;
+    xfer.window = std::max<uint16_t>(1, std::min<uint16_t>(opts.window, CONFIG_TC_FILE_MAX_WINDOW));
+    xfer.unacked = 0;
+    xfer.gap_acked = false;
+    xfer.xfer_id = opts.xfer_id;
+    xfer.next_ckpt = (opts.xfer_id != 0 && opts.encoding == XFER_RAW) ? xfer.offset + XFER_CKPT_INTERVAL : 0;
+
+    ESP_LOGI(TAG, "BeginFileWrite: %s session=%u len=%zu window=%u encoding=%u from=%zu", path, xfer.session, expect_len, xfer.window, xfer.encoding, xfer.offset);
+
+    tcfg_client::file_begin_ack_pkt pkt = {};
+    pkt.state = CHUNK_XFER_NEXT;
+    pkt.aux_info = xfer.offset;
+    pkt.window = xfer.window;
+    return send_xfer_ack(xfer.session, &pkt, sizeof(pkt));
+}
+
+esp_err_t tcfg_client::resume_file_xfer(tcfg_client::file_xfer &xfer, const char *path, size_t expect_len, uint32_t xfer_id)
+{
+    // Mostly path, so it lives in PSRAM rather than on the receive task's stack
+    auto *ckpt = (tcfg_client::xfer_checkpoint *)heap_caps_calloc(1, sizeof(tcfg_client::xfer_checkpoint), MALLOC_CAP_SPIRAM);
+    if (ckpt == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (load_xfer_checkpoint(xfer.ckpt_key, ckpt) != ESP_OK || ckpt->xfer_id != xfer_id || ckpt->total_len != expect_len
+        || ckpt->committed > expect_len || strncmp(ckpt->path, path, sizeof(ckpt->path)) != 0) {
+        free(ckpt);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t committed = ckpt->committed;
+    uint8_t ckpt_hash[sizeof(ckpt->hash)] = {};
+    memcpy(ckpt_hash, ckpt->hash, sizeof(ckpt_hash));
+    free(ckpt);
+
+    FILE *fp = fopen(path, "r+b");
+    if (fp == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    setvbuf(fp, nullptr, _IONBF, 0);
+
+    // The checkpoint vouches for what was on flash back then, make sure it's still the same bytes before building on them
+    uint8_t hash[32] = {};
+    mbedtls_sha256_init(&xfer.sha);
+    mbedtls_sha256_starts(&xfer.sha, /*is224=*/0);
+    auto ret = hash_file_prefix(fp, committed, &xfer.sha);
+    ret = ret ?: sha256_snapshot(&xfer.sha, hash);
+    ret = ret ?: (memcmp(hash, ckpt_hash, sizeof(hash)) == 0 ? ESP_OK : ESP_ERR_INVALID_CRC);
+    ret = ret ?: (fseek(fp, committed, SEEK_SET) == 0 ? ESP_OK : ESP_FAIL);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "BeginFileWrite: checkpoint of %s doesn't hold up, ret=%d; starting over", path, ret);
+        mbedtls_sha256_free(&xfer.sha);
+        fclose(fp);
+        return ret;
+    }
+
+    xfer.fp = fp;
+    xfer.offset = committed;
+    return ESP_OK;
+}
+
+void tcfg_client::checkpoint_file_xfer(tcfg_client::file_xfer &xfer, size_t committed)
+{
+    xfer.next_ckpt = committed + XFER_CKPT_INTERVAL;
+    if (committed >= xfer.expect_len) {
+        return; // About to finish anyway, and a resume with nothing left to send would never complete
+    }
+
+    auto *ckpt = (tcfg_client::xfer_checkpoint *)heap_caps_calloc(1, sizeof(tcfg_client::xfer_checkpoint), MALLOC_CAP_SPIRAM);
+    if (ckpt == nullptr) {
+        ESP_LOGW(TAG, "FileChunk: no memory for checkpoint at %zu", committed);
+        return;
+    }
+
+    ckpt->xfer_id = xfer.xfer_id;
+    ckpt->total_len = xfer.expect_len;
+    ckpt->committed = committed;
+    snprintf(ckpt->path, sizeof(ckpt->path), "%s", xfer.path);
+
+    // Only vouch for what the FS has really put on flash
+    auto ret = (fflush(xfer.fp) == 0 && fsync(fileno(xfer.fp)) == 0) ? ESP_OK : ESP_FAIL;
+    ret = ret ?: sha256_snapshot(&xfer.sha, ckpt->hash);
+    ret = ret ?: save_xfer_checkpoint(xfer.ckpt_key, *ckpt);
+    free(ckpt);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "FileChunk: checkpoint at %zu failed, ret=%d", committed, ret);
+    }
+}
+
+tcfg_client::file_xfer *tcfg_client::find_file_xfer(uint8_t session)
+{
+    for (auto &xfer : file_xfers) {
+        if (xfer.fp != nullptr && xfer.session == session) {
+            return &xfer;
+        }
+    }
+
+    return nullptr;
+}
+
+esp_err_t tcfg_client::handle_file_chunk(const uint8_t *buf, uint16_t len)
+{
+    // Plain PKT_FILE_CHUNK carries no offset, it always continues where the last one ended
+    auto *xfer = find_file_xfer(0);
+    return handle_file_chunk_at(0, xfer != nullptr ? xfer->stream_offset : 0, buf, len);
+}
+
+esp_err_t tcfg_client::handle_file_chunk_at(uint8_t session, uint32_t offset, const uint8_t *buf, uint16_t len)
+{
+    auto *slot = find_file_xfer(session);
+    if (slot == nullptr) {
+        ESP_LOGE(TAG, "FileChunk: session %u not started yet!", session);
+        send_nack(ESP_ERR_INVALID_STATE);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    auto &xfer = *slot;
+    if (buf == nullptr || len == 0) {
+        ESP_LOGW(TAG, "FileChunk: abort requested for session %u", session);
+        send_xfer_state(session, CHUNK_ERR_ABORT_REQUESTED);
+        close_file_xfer(xfer);
+        return ESP_OK;
+    }
+
+    // Chunk offsets count bytes on the wire, which are compressed ones for XFER_DEFLATE
+    if (offset != xfer.stream_offset) {
+        // Retransmit of something already written, or a chunk after a lost one. Either way the host
+        // has to continue from our offset; for a gap, only tell it once until we make progress again.
+        if (offset < xfer.stream_offset || !xfer.gap_acked) {
+            ESP_LOGW(TAG, "FileChunk: got offset %" PRIu32 ", expecting %zu", offset, xfer.stream_offset);
+            xfer.gap_acked = offset > xfer.stream_offset;
+            xfer.unacked = 0;
+            return send_xfer_progress(session, xfer.encoding != XFER_RAW, xfer.offset, xfer.stream_offset);
+        }
+
+        return ESP_OK;
+    }
+
+    esp_err_t ret = ESP_OK;
+    bool stream_done = false;
+    if (xfer.encoding == XFER_RAW) {
+        ret = store_file_data(xfer, buf, len);
+        stream_done = xfer.offset == xfer.expect_len;
+    } else {
+        tcfg_client::file_inflate_sink sink;
+        sink.xfer = &xfer;
+        size_t consumed = 0;
+        auto status = xfer.inflate.feed(buf, len, sink, &consumed);
+        ret = sink.ret;
+        if (ret == ESP_OK && (status == tcfg_inflate::INFLATE_ERROR || consumed != len)) {
+            ESP_LOGE(TAG, "FileChunk: deflate stream corrupted at %" PRIu32, offset);
+            ret = ESP_ERR_INVALID_RESPONSE;
+        }
+
+        stream_done = status == tcfg_inflate::INFLATE_DONE;
+    }
+
+    if (ret != ESP_OK) {
+        send_xfer_state(session, chunk_state::CHUNK_ERR_INTERNAL, ret);
+        close_file_xfer(xfer);
+        return ret;
+    }
+
+    xfer.stream_offset += len;
+    xfer.unacked += 1;
+    xfer.gap_acked = false;
+
+    if (xfer.offset == xfer.expect_len && stream_done) {
+        return finish_file_xfer(xfer);
+    }
+
+    if (stream_done) {
+        ESP_LOGE(TAG, "FileChunk: deflate stream ended at %zu of %zu bytes", xfer.offset, xfer.expect_len);
+        send_xfer_state(session, chunk_state::CHUNK_ERR_INTERNAL, ESP_ERR_INVALID_SIZE);
+        close_file_xfer(xfer);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Acks are cumulative, so with a window the host only needs one every half window to keep the pipe full
+    if (xfer.unacked >= std::max(1, xfer.window / 2)) {
+        xfer.unacked = 0;
+        return send_xfer_progress(session, xfer.encoding != XFER_RAW, xfer.offset, xfer.stream_offset);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tcfg_client::store_file_data(tcfg_client::file_xfer &xfer, const uint8_t *buf, size_t len)
+{
+    if (xfer.offset + len > xfer.expect_len) {
+        ESP_LOGE(TAG, "FileChunk: file written more than it supposed to: %zu > %zu", xfer.offset + len, xfer.expect_len);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (write_file_data(xfer, buf, len) != ESP_OK) {
+        ESP_LOGE(TAG, "FileChunk: can't write in full at %zu, errno %d", xfer.offset, errno);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xfer.offset += len;
+    return ESP_OK;
+}
+
+bool tcfg_client::file_inflate_sink::write_out(const uint8_t *buf, size_t len)
+{
+    ret = tcfg_client::instance()->store_file_data(*xfer, buf, len);
+    return ret == ESP_OK;
+}
+
+esp_err_t tcfg_client::send_xfer_ack(uint8_t session, const void *pkt, size_t len)
+{
+    // Session 0 keeps the plain PKT_CHUNK_ACK replies hosts without sessions expect
+    if (session == 0) {
+        return send_pkt(PKT_CHUNK_ACK, (const uint8_t *)pkt, len);
+    }
+
+    uint8_t buf[sizeof(tcfg_client::session_ack_hdr) + sizeof(tcfg_client::file_done_ack_pkt)] = {};
+    if (len > sizeof(buf) - sizeof(tcfg_client::session_ack_hdr)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    auto *hdr = (tcfg_client::session_ack_hdr *)buf;
+    hdr->session = session;
+    memcpy(buf + sizeof(tcfg_client::session_ack_hdr), pkt, len);
+    return send_pkt(PKT_SESSION_CHUNK_ACK, buf, sizeof(tcfg_client::session_ack_hdr) + len);
+}
+
+esp_err_t tcfg_client::send_xfer_state(uint8_t session, tcfg_client::chunk_state state, uint32_t aux)
+{
+    tcfg_client::chunk_ack_pkt pkt = {};
+    pkt.state = state;
+    pkt.aux_info = aux;
+    return send_xfer_ack(session, &pkt, sizeof(pkt));
+}
+
+esp_err_t tcfg_client::send_xfer_progress(uint8_t session, bool transformed, uint32_t offset, uint32_t stream_offset)
+{
+    if (!transformed) {
+        return send_xfer_state(session, CHUNK_XFER_NEXT, offset);
+    }
+
+    tcfg_client::chunk_progress_ack_pkt pkt = {};
+    pkt.state = CHUNK_XFER_NEXT;
+    pkt.aux_info = offset;
+    pkt.stream_offset = stream_offset;
+    return send_xfer_ack(session, &pkt, sizeof(pkt));
+}
+
+esp_err_t tcfg_client::write_file_data(tcfg_client::file_xfer &xfer, const uint8_t *buf, size_t len)
+{
+    // Hash while the chunk is still hot, so nobody needs to read the file back to check it. Whatever has been
+    // hashed has also been handed to the FS whenever wb_buf is empty, which is when a checkpoint can be taken.
+    size_t written = xfer.offset;
+    if (xfer.wb_buf == nullptr) {
+        mbedtls_sha256_update(&xfer.sha, buf, len);
+        if (fwrite(buf, 1, len, xfer.fp) != len) {
+            return ESP_FAIL;
+        }
+
+        if (xfer.next_ckpt != 0 && written + len >= xfer.next_ckpt) {
+            checkpoint_file_xfer(xfer, written + len);
+        }
+
+        return ESP_OK;
+    }
+
+    while (len > 0) {
+        size_t copy_len = std::min(len, FILE_WB_SIZE - xfer.wb_len);
+        memcpy(xfer.wb_buf + xfer.wb_len, buf, copy_len);
+        mbedtls_sha256_update(&xfer.sha, buf, copy_len);
+        xfer.wb_len += copy_len;
+        written += copy_len;
+        buf += copy_len;
+        len -= copy_len;
+
+        if (xfer.wb_len == FILE_WB_SIZE) {
+            if (flush_file_wb(xfer) != ESP_OK) {
+                return ESP_FAIL;
+            }
+
+            if (xfer.next_ckpt != 0 && written >= xfer.next_ckpt) {
+                checkpoint_file_xfer(xfer, written);
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tcfg_client::flush_file_wb(tcfg_client::file_xfer &xfer)
+{
+    if (xfer.wb_buf == nullptr || xfer.wb_len == 0) {
+        return ESP_OK;
+    }
+
+    size_t write_len = fwrite(xfer.wb_buf, 1, xfer.wb_len, xfer.fp);
+    bool ok = write_len == xfer.wb_len;
+    xfer.wb_len = 0;
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t tcfg_client::finish_file_xfer(tcfg_client::file_xfer &xfer)
+{
+    tcfg_client::file_done_ack_pkt pkt = {};
+    pkt.state = CHUNK_XFER_DONE;
+    pkt.aux_info = xfer.expect_len;
+    if (mbedtls_sha256_finish(&xfer.sha, pkt.hash) != 0) {
+        ESP_LOGE(TAG, "FileChunk: can't finalise SHA256");
+        send_xfer_state(xfer.session, chunk_state::CHUNK_ERR_INTERNAL, ESP_FAIL);
+        close_file_xfer(xfer);
+        return ESP_FAIL;
+    }
+
+    // Rejected while the file is still open: the rest of it is never written, and it's emptied before it's let go,
+    // so even if the unlink() below never happens there's no bad copy left under the real name
+    if (xfer.verify && memcmp(pkt.hash, xfer.expect_hash, sizeof(pkt.hash)) != 0) {
+        ESP_LOGE(TAG, "FileChunk: %s doesn't match the expected SHA256, deleting it", xfer.path);
+        xfer.wb_len = 0;
+        xfer.offset = 0;
+        close_file_xfer(xfer);
+        if (unlink(xfer.path) != 0) {
+            ESP_LOGE(TAG, "FileChunk: can't delete %s, errno %d; left empty", xfer.path, errno);
+        }
+
+        pkt.state = CHUNK_ERR_HASH_MISMATCH;
+        return send_xfer_ack(xfer.session, &pkt, sizeof(pkt));
+    }
+
+    if (flush_file_wb(xfer) != ESP_OK || fflush(xfer.fp) != 0) {
+        ESP_LOGE(TAG, "FileChunk: final write failed, errno %d", errno);
+        send_xfer_state(xfer.session, chunk_state::CHUNK_ERR_INTERNAL, ESP_ERR_INVALID_SIZE);
+        close_file_xfer(xfer);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    close_file_xfer(xfer);
+
+    ESP_LOGI(TAG, "FileChunk: session %u received %zu OK", xfer.session, xfer.expect_len);
+
+    struct stat st = {};
+    if (stat(xfer.path, &st) == 0) {
+        hash_cache.store(xfer.path, st.st_size, st.st_mtime, pkt.hash);
+    }
+
+    return send_xfer_ack(xfer.session, &pkt, sizeof(pkt));
+}
+
+void tcfg_client::close_file_xfer(tcfg_client::file_xfer &xfer)
+{
+    if (xfer.fp != nullptr) {
+        if (xfer.offset < xfer.expect_len) {
+            // Aborted: keep what was received, and give back the preallocated tail
+            flush_file_wb(xfer);
+            fflush(xfer.fp);
+            ftruncate(fileno(xfer.fp), xfer.offset);
+        }
+
+        fclose(xfer.fp);
+        xfer.fp = nullptr;
+        free(xfer.wb_buf);
+        xfer.wb_buf = nullptr;
+        xfer.wb_len = 0;
+        xfer.inflate.end();
+        mbedtls_sha256_free(&xfer.sha);
+        hash_cache.invalidate(xfer.path); // In case it was hashed mid-upload
+
+        // Finished, failed or given up on: either way there's nothing left to resume
+        if (xfer.next_ckpt != 0) {
+            clear_xfer_checkpoint(xfer.ckpt_key);
+        }
+    }
+
+    xfer.xfer_id = 0;
+    xfer.next_ckpt = 0;
+
+    xfer.unacked = 0;
+    xfer.gap_acked = false;
+}
+
+esp_err_t tcfg_client::handle_file_read(const char *path, uint32_t offset, uint32_t len)
+{
+    FILE *read_fp = fopen(path, "rb");
+    if (read_fp == nullptr) {
+        ESP_LOGE(TAG, "FileRead: Can't open %s", path);
+        return send_nack(ESP_ERR_NOT_FOUND);
+    }
+
+    struct stat st = {};
+    if (fstat(fileno(read_fp), &st) != 0 || offset > st.st_size || fseek(read_fp, offset, SEEK_SET) != 0) {
+        ESP_LOGE(TAG, "FileRead: offset %" PRIu32 " not readable, errno %d", offset, errno);
+        fclose(read_fp);
+        return send_nack(ESP_ERR_INVALID_ARG);
+    }
+
+    size_t remain = st.st_size - offset;
+    if (len > 0) {
+        remain = std::min<size_t>(remain, len);
+    }
+
+    // Leave room for a stream_chunk_pkt in front of the data, and read whole frames at a time
+    const size_t data_cap = std::min<size_t>(TCFG_WIRE_MAX_PACKET_SIZE, curr_wire->max_packet_size() - sizeof(tcfg_client::header)) - sizeof(tcfg_client::stream_chunk_pkt);
+    const size_t block_cap = std::max<size_t>(1, CONFIG_TC_FILE_READ_BUF_SIZE / data_cap) * data_cap;
+    auto *read_buf = (uint8_t *)heap_caps_malloc(sizeof(tcfg_client::stream_chunk_pkt) + block_cap, MALLOC_CAP_SPIRAM);
+    if (read_buf == nullptr) {
+        ESP_LOGE(TAG, "FileRead: can't allocate read buffer");
+        fclose(read_fp);
+        return send_nack(ESP_ERR_NO_MEM);
+    }
+
+    // Reading in big blocks already, so skip the stdio buffer and its extra copy
+    setvbuf(read_fp, nullptr, _IONBF, 0);
+
+    ESP_LOGI(TAG, "FileRead: %s offset=%" PRIu32 " len=%zu", path, offset, remain);
+
+    esp_err_t ret = ESP_OK;
+    size_t pos = offset;
+    do {
+        size_t want = std::min(block_cap, remain);
+        size_t read_len = fread(read_buf + sizeof(tcfg_client::stream_chunk_pkt), 1, want, read_fp);
+        if (read_len < want) {
+            ESP_LOGE(TAG, "FileRead: short read at %zu, errno %d", pos, errno);
+            ret = ESP_FAIL;
+            break;
+        }
+
+        remain -= read_len;
+        size_t frame_off = 0;
+        do {
+            // Each chunk header goes over the tail of the previous frame's data, which has been sent by now
+            auto *chunk = (tcfg_client::stream_chunk_pkt *)(read_buf + frame_off);
+            size_t chunk_len = std::min(data_cap, read_len - frame_off);
+            chunk->offset = pos + frame_off;
+            chunk->flags = (remain == 0 && frame_off + chunk_len >= read_len) ? STREAM_LAST : 0;
+            ret = send_pkt(PKT_FILE_DATA, (uint8_t *)chunk, sizeof(tcfg_client::stream_chunk_pkt) + chunk_len);
+            frame_off += chunk_len;
+        } while (ret == ESP_OK && frame_off < read_len);
+
+        pos += read_len;
+    } while (ret == ESP_OK && remain > 0);
+
+    free(read_buf);
+    fclose(read_fp);
+
+    if (ret != ESP_OK) {
+        send_nack(ret);
+    }
+
+    return ret;
+}
+
+esp_err_t tcfg_client::handle_file_delete(const char *path)
+{
+    hash_cache.invalidate(path);
+    if (unlink(path) < 0) {
+        send_nack(ESP_FAIL);
+    }
+
+    return send_ack();
+}
+
+esp_err_t tcfg_client::sha256_file(FILE *fp, uint8_t *hash_out, size_t *len_out)
+{
+    // Big reads so FATFS can go cluster-at-a-time. Everything hashed here, like upload chunks and OTA blocks, sits in
+    // PSRAM: the SHA driver bounces it through its own small DMA buffer, cheaper than holding internal RAM for it.
+    auto *buf = (uint8_t *)heap_caps_malloc(HASH_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    if (buf == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    setvbuf(fp, nullptr, _IONBF, 0);
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, /*is224=*/0);
+
+    size_t read_len = 0;
+    size_t total_len = 0;
+    while ((read_len = fread(buf, 1, HASH_BUF_SIZE, fp)) > 0) {
+        mbedtls_sha256_update(&ctx, buf, read_len);
+        total_len += read_len;
+    }
+
+    int sha_ret = ferror(fp) ? -1 : mbedtls_sha256_finish(&ctx, hash_out);
+    mbedtls_sha256_free(&ctx);
+    free(buf);
+    if (sha_ret != 0) {
+        return ESP_FAIL;
+    }
+
+    if (len_out != nullptr) {
+        *len_out = total_len;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tcfg_client::sha256_snapshot(const mbedtls_sha256_context *sha, uint8_t *hash_out)
+{
+    // Digest so far, leaving the running context alone
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, sha);
+    int sha_ret = mbedtls_sha256_finish(&ctx, hash_out);
+    mbedtls_sha256_free(&ctx);
+    return sha_ret == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t tcfg_client::hash_file_prefix(FILE *fp, size_t len, mbedtls_sha256_context *sha)
+{
+    auto *buf = (uint8_t *)heap_caps_malloc(HASH_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    if (buf == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_OK;
+    while (len > 0) {
+        size_t read_len = fread(buf, 1, std::min(len, HASH_BUF_SIZE), fp);
+        if (read_len == 0) {
+            ret = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+
+        mbedtls_sha256_update(sha, buf, read_len);
+        len -= read_len;
+    }
+
+    free(buf);
+    return ret;
+}
+
+esp_err_t tcfg_client::hash_partition_prefix(const esp_partition_t *part, size_t len, mbedtls_sha256_context *sha)
+{
+    if (len > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    auto *buf = (uint8_t *)heap_caps_malloc(HASH_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    if (buf == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_OK;
+    for (size_t offset = 0; offset < len && ret == ESP_OK; offset += HASH_BUF_SIZE) {
+        size_t read_len = std::min(len - offset, HASH_BUF_SIZE);
+        ret = esp_partition_read(part, offset, buf, read_len);
+        if (ret == ESP_OK) {
+            mbedtls_sha256_update(sha, buf, read_len);
+        }
+    }
+
+    free(buf);
+    return ret;
+}
+
+esp_err_t tcfg_client::handle_get_file_info(const char *path)
+{
+    struct stat st = {};
+    if (stat(path, &st) != 0) {
+        ESP_LOGE(TAG, "GetFileInfo: Can't open");
+        send_nack(ESP_ERR_NOT_FOUND);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    tcfg_client::file_info_pkt info_pkt = {};
+    info_pkt.size = st.st_size;
+    if (st.st_size == 0) {
+        ESP_LOGW(TAG, "GetFileInfo: file size 0, skip SHA256");
+        return send_pkt(PKT_FILE_INFO, (uint8_t *)&info_pkt, sizeof(info_pkt));
+    }
+
+    if (hash_cache.lookup(path, st.st_size, st.st_mtime, info_pkt.hash)) {
+        ESP_LOGD(TAG, "GetFileInfo: %s hash cached", path);
+        return send_pkt(PKT_FILE_INFO, (uint8_t *)&info_pkt, sizeof(info_pkt));
+    }
+
+    FILE *file_info_fp = fopen(path, "rb");
+    if (file_info_fp == nullptr) {
+        ESP_LOGE(TAG, "GetFileInfo: Can't open");
+        send_nack(ESP_ERR_NOT_FOUND);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t hashed_len = 0;
+    auto ret = sha256_file(file_info_fp, info_pkt.hash, &hashed_len);
+    fclose(file_info_fp);
+    if (ret != ESP_OK || hashed_len != (size_t)st.st_size) {
+        ESP_LOGE(TAG, "GetFileInfo: Can't finalise SHA256");
+        send_nack(ESP_FAIL);
+        return ESP_FAIL;
+    }
+
+    hash_cache.store(path, st.st_size, st.st_mtime, info_pkt.hash);
+    return send_pkt(PKT_FILE_INFO, (uint8_t *)&info_pkt, sizeof(info_pkt));
+}
+
+esp_err_t tcfg_client::handle_get_file_sig(const char *path, uint32_t block_size)
+{
+    if (block_size < MIN_DELTA_BLOCK_SIZE || block_size > MAX_DELTA_BLOCK_SIZE) {
+        return send_nack(ESP_ERR_INVALID_ARG);
+    }
+
+    FILE *sig_fp = fopen(path, "rb");
+    if (sig_fp == nullptr) {
+        ESP_LOGE(TAG, "GetFileSig: Can't open %s", path);
+        return send_nack(ESP_ERR_NOT_FOUND);
+    }
+
+    struct stat st = {};
+    auto *block_buf = (uint8_t *)heap_caps_malloc(block_size, MALLOC_CAP_SPIRAM);
+    auto *tx_buf = pkt_pool.borrow();
+    if (block_buf == nullptr || tx_buf == nullptr || fstat(fileno(sig_fp), &st) != 0) {
+        free(block_buf);
+        pkt_pool.give_back(tx_buf);
+        fclose(sig_fp);
+        return send_nack(block_buf == nullptr || tx_buf == nullptr ? ESP_ERR_NO_MEM : ESP_FAIL);
+    }
+
+    auto *chunk = (tcfg_client::stream_chunk_pkt *)tx_buf;
+    memset(chunk, 0, sizeof(tcfg_client::stream_chunk_pkt));
+    const size_t data_cap = std::min(PKT_BUF_SIZE, curr_wire->max_packet_size() - sizeof(tcfg_client::header)) - sizeof(tcfg_client::stream_chunk_pkt);
+
+    auto *sig_hdr = (tcfg_client::file_sig_hdr *)chunk->data;
+    sig_hdr->file_len = st.st_size;
+    sig_hdr->block_size = block_size;
+    sig_hdr->count = (st.st_size + block_size - 1) / block_size;
+    ESP_LOGI(TAG, "GetFileSig: %s len=%" PRIu32 ", %" PRIu32 " blocks", path, sig_hdr->file_len, sig_hdr->count);
+
+    // Records never straddle frames, so each frame can be parsed on its own
+    esp_err_t ret = ESP_OK;
+    size_t fill = sizeof(tcfg_client::file_sig_hdr);
+    size_t read_len = 0;
+    while (ret == ESP_OK && (read_len = fread(block_buf, 1, block_size, sig_fp)) > 0) {
+        if (fill + sizeof(tcfg_client::file_block_sig) > data_cap) {
+            chunk->flags = 0;
+            ret = send_pkt(PKT_FILE_SIG, tx_buf, sizeof(tcfg_client::stream_chunk_pkt) + fill);
+            chunk->offset += fill;
+            fill = 0;
+        }
+
+        auto *sig = (tcfg_client::file_block_sig *)(chunk->data + fill);
+        sig->weak = tcfg_delta::weak_sum(block_buf, read_len);
+        if (mbedtls_sha256(block_buf, read_len, sig->strong, /*is224=*/0) != 0) {
+            ret = ESP_FAIL;
+        }
+
+        fill += sizeof(tcfg_client::file_block_sig);
+    }
+
+    if (ret == ESP_OK && ferror(sig_fp)) {
+        ESP_LOGE(TAG, "GetFileSig: read failed, errno %d", errno);
+        ret = ESP_FAIL;
+    }
+
+    free(block_buf);
+    fclose(sig_fp);
+
+    if (ret == ESP_OK) {
+        chunk->flags = STREAM_LAST;
+        ret = send_pkt(PKT_FILE_SIG, tx_buf, sizeof(tcfg_client::stream_chunk_pkt) + fill);
+    } else {
+        ret = send_nack(ret);
+    }
+
+    pkt_pool.give_back(tx_buf);
+    return ret;
+}
+
+bool tcfg_client::file_patch::copy_blocks(uint32_t block, uint32_t count)
+{
+    size_t block_count = (src_len + block_size - 1) / block_size;
+    if (block >= block_count || count > block_count - block) {
+        ESP_LOGE(TAG, "FilePatch: copy of blocks %" PRIu32 "+%" PRIu32 " is out of range", block, count);
+        return false;
+    }
+
+    size_t start = block * block_size;
+    size_t remain = std::min(src_len, (block + count) * block_size) - start;
+    if (remain > out_len - written || fseek(src_fp, start, SEEK_SET) != 0) {
+        return false;
+    }
+
+    while (remain > 0) {
+        size_t read_len = fread(copy_buf, 1, std::min<size_t>(remain, CONFIG_TC_FILE_READ_BUF_SIZE), src_fp);
+        if (read_len == 0 || fwrite(copy_buf, 1, read_len, dst_fp) != read_len) {
+            ESP_LOGE(TAG, "FilePatch: block copy failed, errno %d", errno);
+            return false;
+        }
+
+        written += read_len;
+        remain -= read_len;
+    }
+
+    return true;
+}
+
+bool tcfg_client::file_patch::write_literal(const uint8_t *buf, size_t len)
+{
+    if (len > out_len - written || fwrite(buf, 1, len, dst_fp) != len) {
+        return false;
+    }
+
+    written += len;
+    return true;
+}
+
+esp_err_t tcfg_client::handle_begin_file_patch(const tcfg_client::file_patch_begin_pkt &req)
+{
+    if (req.block_size < MIN_DELTA_BLOCK_SIZE || req.block_size > MAX_DELTA_BLOCK_SIZE) {
+        return send_nack(ESP_ERR_INVALID_ARG);
+    }
+
+    if (patch_ctx.dst_fp != nullptr) {
+        ESP_LOGW(TAG, "BeginFilePatch: previous patch not finished, dropping it");
+        close_file_patch(true);
+    }
+
+    snprintf(patch_ctx.path, sizeof(patch_ctx.path), "%.*s", (int)strnlen(req.path, sizeof(req.path)), req.path);
+    snprintf(patch_ctx.tmp_path, sizeof(patch_ctx.tmp_path), "%s.tmp", patch_ctx.path);
+    memcpy(patch_ctx.expect_hash, req.hash, sizeof(patch_ctx.expect_hash));
+    patch_ctx.block_size = req.block_size;
+    patch_ctx.out_len = req.out_len;
+
+    struct stat st = {};
+    patch_ctx.src_fp = fopen(patch_ctx.path, "rb");
+    if (patch_ctx.src_fp == nullptr || fstat(fileno(patch_ctx.src_fp), &st) != 0) {
+        ESP_LOGE(TAG, "BeginFilePatch: Can't open %s", patch_ctx.path);
+        close_file_patch(false);
+        return send_nack(ESP_ERR_NOT_FOUND);
+    }
+
+    patch_ctx.src_len = st.st_size;
+    patch_ctx.copy_buf = (uint8_t *)heap_caps_malloc(CONFIG_TC_FILE_READ_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    patch_ctx.dst_fp = fopen(patch_ctx.tmp_path, "wb");
+    if (patch_ctx.copy_buf == nullptr || patch_ctx.dst_fp == nullptr) {
+        ESP_LOGE(TAG, "BeginFilePatch: Can't set up %s", patch_ctx.tmp_path);
+        close_file_patch(true);
+        return send_nack(ESP_FAIL);
+    }
+
+    ESP_LOGI(TAG, "BeginFilePatch: %s %zu -> %zu bytes, block %zu", patch_ctx.path, patch_ctx.src_len, patch_ctx.out_len, patch_ctx.block_size);
+    return send_chunk_ack(CHUNK_XFER_NEXT, 0);
+}
+
+esp_err_t tcfg_client::handle_file_patch_chunk(uint32_t offset, uint8_t flags, const uint8_t *buf, size_t len)
+{
+    if (patch_ctx.dst_fp == nullptr) {
+        return send_nack(ESP_ERR_INVALID_STATE);
+    }
+
+    if (offset != patch_ctx.stream_offset) {
+        return send_chunk_ack(CHUNK_XFER_NEXT, patch_ctx.stream_offset);
+    }
+
+    if (!tcfg_delta::feed(patch_ctx.parser, buf, len, patch_ctx)) {
+        ESP_LOGE(TAG, "FilePatch: bad op stream around offset %" PRIu32, offset);
+        close_file_patch(true);
+        return send_nack(ESP_ERR_INVALID_ARG);
+    }
+
+    patch_ctx.stream_offset += len;
+    if ((flags & STREAM_LAST) == 0) {
+        return send_chunk_ack(CHUNK_XFER_NEXT, patch_ctx.stream_offset);
+    }
+
+    return finish_file_patch();
+}
+
+esp_err_t tcfg_client::finish_file_patch()
+{
+    if (!tcfg_delta::at_op_boundary(patch_ctx.parser) || patch_ctx.written != patch_ctx.out_len) {
+        ESP_LOGE(TAG, "FilePatch: stream ended early, %zu of %zu bytes", patch_ctx.written, patch_ctx.out_len);
+        close_file_patch(true);
+        return send_nack(ESP_ERR_INVALID_SIZE);
+    }
+
+    fflush(patch_ctx.dst_fp);
+    fsync(fileno(patch_ctx.dst_fp));
+    fclose(patch_ctx.dst_fp);
+    patch_ctx.dst_fp = nullptr;
+
+    // Hash what actually landed on flash, not what was meant to be written
+    uint8_t hash[32] = {};
+    size_t hashed_len = 0;
+    esp_err_t ret = ESP_FAIL;
+    FILE *verify_fp = fopen(patch_ctx.tmp_path, "rb");
+    if (verify_fp != nullptr) {
+        ret = sha256_file(verify_fp, hash, &hashed_len);
+        fclose(verify_fp);
+    }
+
+    if (ret != ESP_OK || hashed_len != patch_ctx.out_len || memcmp(hash, patch_ctx.expect_hash, sizeof(hash)) != 0) {
+        ESP_LOGE(TAG, "FilePatch: %s failed verification", patch_ctx.path);
+        close_file_patch(true);
+        return send_nack(ESP_ERR_INVALID_CRC);
+    }
+
+    fclose(patch_ctx.src_fp);
+    patch_ctx.src_fp = nullptr;
+    hash_cache.invalidate(patch_ctx.path);
+
+    if (tcfg_fs::replace_file(patch_ctx.tmp_path, patch_ctx.path) != ESP_OK) {
+        ESP_LOGE(TAG, "FilePatch: can't move %s into place", patch_ctx.tmp_path);
+        close_file_patch(true);
+        return send_nack(ESP_FAIL);
+    }
+
+    ESP_LOGI(TAG, "FilePatch: %s patched, %zu bytes", patch_ctx.path, patch_ctx.written);
+    size_t written = patch_ctx.written;
+    close_file_patch(false);
+    return send_chunk_ack(CHUNK_XFER_DONE, written);
+}
+
+void tcfg_client::close_file_patch(bool discard)
+{
+    if (patch_ctx.src_fp != nullptr) {
+        fclose(patch_ctx.src_fp);
+    }
+
+    if (patch_ctx.dst_fp != nullptr) {
+        fclose(patch_ctx.dst_fp);
+    }
+
+    if (discard && patch_ctx.tmp_path[0] != '\0') {
+        unlink(patch_ctx.tmp_path);
+    }
+
+    free(patch_ctx.copy_buf);
+    patch_ctx = tcfg_client::file_patch();
+}
+
+esp_err_t tcfg_client::handle_ota_begin(const tcfg_client::ota_begin_opts &opts)
+{
+    if (ota_handle != 0 && opts.xfer_id != 0 && opts.xfer_id == ota_xfer_id && opts.encoding == ota_encoding) {
+        // The link dropped mid-OTA but this side never stopped: everything acked is queued or written already
+        ESP_LOGW(TAG, "OTA picked up again at %" PRIu32, ota_stream_offset);
+        return send_chunk_ack(CHUNK_XFER_NEXT, ota_stream_offset);
+    }
+
+    if (ota_handle != 0) {
+        ESP_LOGW(TAG, "OTA already started!");
+        send_nack(ESP_ERR_INVALID_STATE);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (opts.encoding != XFER_RAW && opts.encoding != XFER_DEFLATE) {
+        ESP_LOGE(TAG, "OTA: unknown encoding %u", opts.encoding);
+        send_nack(ESP_ERR_NOT_SUPPORTED);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    curr_ota_part = esp_ota_get_next_update_partition(nullptr);
+    if (curr_ota_part == nullptr) {
+        ESP_LOGW(TAG, "OTA partition not present!");
+        send_nack(ESP_ERR_NOT_SUPPORTED);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    ota_delta = (opts.flags & OTA_DELTA) != 0;
+    if (ota_delta) {
+        // A patch only makes sense against the exact image it was made from
+        if (memcmp(opts.base_hash, dev_info.fw_hash, sizeof(dev_info.fw_hash)) != 0) {
+            ESP_LOGE(TAG, "OTA delta is for a different base firmware");
+            ota_delta = false;
+            send_nack(ESP_ERR_INVALID_VERSION);
+            return ESP_ERR_INVALID_VERSION;
+        }
+
+        ota_base_part = esp_ota_get_running_partition();
+        ota_base_buf = (uint8_t *)heap_caps_malloc(OTA_BASE_BUF_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        tcfg_delta::reset(ota_patcher);
+    }
+
+    auto ota_ret = alloc_ota_bufs();
+    if (ota_ret == ESP_OK && opts.encoding == XFER_DEFLATE && !ota_inflate.begin(CONFIG_TC_INFLATE_DICT_SIZE)) {
+        free_ota_bufs();
+        ota_ret = ESP_ERR_NO_MEM;
+    }
+
+    if (ota_ret == ESP_OK && ota_delta && (ota_base_part == nullptr || ota_base_buf == nullptr)) {
+        free_ota_bufs();
+        ota_inflate.end();
+        ota_ret = ESP_ERR_NO_MEM;
+    }
+
+    if (ota_ret != ESP_OK) {
+        ESP_LOGE(TAG, "OTA can't allocate chunk buffers");
+        end_ota_delta();
+        send_nack(ota_ret);
+        return ota_ret;
+    }
+
+    // Raw, non-delta images can also be checkpointed and picked up again after a reboot
+    bool resumable = opts.xfer_id != 0 && opts.encoding == XFER_RAW && !ota_delta && TC_OTA_CAN_RESUME;
+    mbedtls_sha256_init(&ota_sha);
+    mbedtls_sha256_starts(&ota_sha, /*is224=*/0);
+    ota_written = 0;
+    if (!resumable || resume_ota(opts.xfer_id) != ESP_OK) {
+        ota_ret = esp_ota_begin(curr_ota_part, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+    }
+
+    if (ota_ret != ESP_OK) {
+        ESP_LOGE(TAG, "OTA begin failed; ret=%d %s", ota_ret, esp_err_to_name(ota_ret));
+        ota_inflate.end();
+        end_ota_delta();
+        mbedtls_sha256_free(&ota_sha);
+        reset_ota(); // Neither esp_ota_begin() nor esp_ota_resume() leaves a handle behind when it fails
+        send_nack(ota_ret);
+        return ota_ret;
+    }
+
+    ESP_LOGW(TAG, "OTA begin, encoding=%u delta=%d from=%" PRIu32, opts.encoding, ota_delta, ota_written);
+    ota_write_ret = ESP_OK;
+    ota_encoding = opts.encoding;
+    curr_ota_chunk_offset = ota_written;
+    ota_stream_offset = ota_written;
+    ota_xfer_id = opts.xfer_id;
+    ota_next_ckpt = resumable ? ota_written + XFER_CKPT_INTERVAL : 0;
+    if (opts.xfer_id != 0) {
+        return send_chunk_ack(CHUNK_XFER_NEXT, ota_stream_offset);
+    }
+
+    return send_ack();
+}
+
+esp_err_t tcfg_client::resume_ota(uint32_t xfer_id)
+{
+#if TC_OTA_CAN_RESUME
+    auto *ckpt = (tcfg_client::xfer_checkpoint *)heap_caps_calloc(1, sizeof(tcfg_client::xfer_checkpoint), MALLOC_CAP_SPIRAM);
+    if (ckpt == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (load_xfer_checkpoint(XFER_KEY_OTA, ckpt) != ESP_OK || ckpt->xfer_id != xfer_id || ckpt->part_addr != curr_ota_part->address
+        || ckpt->committed % SPI_FLASH_SEC_SIZE != 0) {
+        free(ckpt);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t committed = ckpt->committed;
+    uint8_t ckpt_hash[sizeof(ckpt->hash)] = {};
+    memcpy(ckpt_hash, ckpt->hash, sizeof(ckpt_hash));
+    free(ckpt);
+
+    // Re-reading the partition both checks the checkpoint and gets the running hash back to where it was
+    uint8_t hash[32] = {};
+    auto ret = hash_partition_prefix(curr_ota_part, committed, &ota_sha);
+    ret = ret ?: sha256_snapshot(&ota_sha, hash);
+    ret = ret ?: (memcmp(hash, ckpt_hash, sizeof(hash)) == 0 ? ESP_OK : ESP_ERR_INVALID_CRC);
+    ret = ret ?: esp_ota_resume(curr_ota_part, OTA_WITH_SEQUENTIAL_WRITES, committed, &ota_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "OTA checkpoint doesn't hold up, ret=%d; starting over", ret);
+        mbedtls_sha256_starts(&ota_sha, /*is224=*/0);
+        ota_handle = 0;
+        return ret;
+    }
+
+    ota_written = committed;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void tcfg_client::track_ota_written(const uint8_t *buf, size_t len)
+{
+    // Runs on the writer task, so a checkpoint never covers anything esp_ota_write() hasn't taken yet.
+    // Checkpoints land on sector boundaries, where a resumed sequential write starts with a fresh erase.
+    while (len > 0) {
+        size_t hash_len = std::min<size_t>(len, ota_next_ckpt - ota_written);
+        mbedtls_sha256_update(&ota_sha, buf, hash_len);
+        ota_written += hash_len;
+        buf += hash_len;
+        len -= hash_len;
+
+        if (ota_written == ota_next_ckpt) {
+            ota_next_ckpt += XFER_CKPT_INTERVAL;
+
+            tcfg_client::xfer_checkpoint ckpt = {};
+            ckpt.xfer_id = ota_xfer_id;
+            ckpt.part_addr = curr_ota_part->address;
+            ckpt.committed = ota_written;
+            auto ret = sha256_snapshot(&ota_sha, ckpt.hash);
+            ret = ret ?: save_xfer_checkpoint(XFER_KEY_OTA, ckpt);
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "OTA checkpoint at %" PRIu32 " failed, ret=%d", ota_written, ret);
+            }
+        }
+    }
+}
+
+void tcfg_client::end_ota_resume()
+{
+    // Only with the writer idle, it's the one updating the hash
+    if (ota_next_ckpt != 0) {
+        clear_xfer_checkpoint(XFER_KEY_OTA);
+    }
+
+    mbedtls_sha256_free(&ota_sha);
+    ota_xfer_id = 0;
+    ota_next_ckpt = 0;
+    ota_written = 0;
+}
+
+esp_err_t tcfg_client::handle_ota_chunk(const uint8_t *buf, uint16_t len)
+{
+    if (ota_handle == 0) {
+        ESP_LOGE(TAG, "OTA not started yet!");
+        return send_nack(ESP_ERR_INVALID_STATE);
+    }
+
+    if (len == 0) {
+        ESP_LOGW(TAG, "OTA abort requested!");
+        uint32_t aborted_at = curr_ota_chunk_offset;
+        auto ret = abort_ota();
+        if (ret != ESP_OK) {
+            send_chunk_ack(CHUNK_ERR_INTERNAL, ret);
+            return ret;
+        }
+
+        return send_chunk_ack(CHUNK_ERR_ABORT_REQUESTED, aborted_at);
+    }
+
+    esp_err_t ret = ota_write_ret;
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "OTA writer failed earlier, ret=%d; aborting", ret);
+        abort_ota();
+        send_chunk_ack(CHUNK_ERR_INTERNAL, ret);
+        return ret;
+    }
+
+    if (ota_encoding == XFER_RAW) {
+        ret = feed_ota_payload(buf, len);
+    } else {
+        tcfg_client::ota_inflate_sink sink;
+        size_t consumed = 0;
+        auto status = ota_inflate.feed(buf, len, sink, &consumed);
+        ret = sink.ret;
+        if (ret == ESP_OK && (status == tcfg_inflate::INFLATE_ERROR || consumed != len)) {
+            ESP_LOGE(TAG, "OTA deflate stream corrupted at %" PRIu32, ota_stream_offset);
+            ret = ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    if (ret != ESP_OK) {
+        abort_ota();
+        send_chunk_ack(CHUNK_ERR_INTERNAL, ret);
+        return ret;
+    }
+
+    ota_stream_offset += len;
+    return send_xfer_progress(0, ota_encoding != XFER_RAW || ota_delta, curr_ota_chunk_offset, ota_stream_offset);
+}
+
+esp_err_t tcfg_client::feed_ota_payload(const uint8_t *buf, size_t len)
+{
+    if (!ota_delta) {
+        return store_ota_data(buf, len);
+    }
+
+    tcfg_client::ota_patch_sink sink;
+    if (!tcfg_delta::feed(ota_patcher, buf, len, sink)) {
+        ESP_LOGE(TAG, "OTA delta failed around image offset %" PRIu32 ", ret=%d", curr_ota_chunk_offset, sink.ret);
+        return sink.ret ?: ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tcfg_client::store_ota_base(uint32_t offset, const uint8_t *diff, size_t len)
+{
+    if (len > ota_base_part->size || offset > ota_base_part->size - len) {
+        ESP_LOGE(TAG, "OTA delta reads past the running image: %" PRIu32 "+%zu", offset, len);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (len > 0) {
+        size_t read_len = std::min(len, OTA_BASE_BUF_SIZE);
+        auto ret = esp_partition_read(ota_base_part, offset, ota_base_buf, read_len);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        if (diff != nullptr) {
+            for (size_t idx = 0; idx < read_len; idx += 1) {
+                ota_base_buf[idx] += diff[idx];
+            }
+
+            diff += read_len;
+        }
+
+        ret = store_ota_data(ota_base_buf, read_len);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        offset += read_len;
+        len -= read_len;
+    }
+
+    return ESP_OK;
+}
+
+void tcfg_client::end_ota_delta()
+{
+    heap_caps_free(ota_base_buf);
+    ota_base_buf = nullptr;
+    ota_base_part = nullptr;
+    ota_delta = false;
+    tcfg_delta::reset(ota_patcher);
+}
+
+bool tcfg_client::ota_patch_sink::copy_blocks(uint32_t block, uint32_t count)
+{
+    (void)block;
+    (void)count;
+    ret = ESP_ERR_NOT_SUPPORTED;
+    return false; // Block copies need the signatures of PKT_GET_FILE_SIG, firmware deltas use byte ranges
+}
+
+bool tcfg_client::ota_patch_sink::write_literal(const uint8_t *buf, size_t len)
+{
+    ret = tcfg_client::instance()->store_ota_data(buf, len);
+    return ret == ESP_OK;
+}
+
+bool tcfg_client::ota_patch_sink::copy_range(uint32_t offset, uint32_t len)
+{
+    ret = tcfg_client::instance()->store_ota_base(offset, nullptr, len);
+    return ret == ESP_OK;
+}
+
+bool tcfg_client::ota_patch_sink::add_range(uint32_t offset, const uint8_t *diff, size_t len)
+{
+    ret = tcfg_client::instance()->store_ota_base(offset, diff, len);
+    return ret == ESP_OK;
+}
+
+esp_err_t tcfg_client::store_ota_data(const uint8_t *buf, size_t len)
+{
+    // Output is packed into whole buffers before it's queued, whatever size the chunks (or inflate output) come in
+    while (len > 0) {
+        if (ota_fill_buf == nullptr) {
+            // Blocks only while all buffers are queued for flash, which is what throttles the host
+            if (xQueueReceive(ota_free_q, &ota_fill_buf, portMAX_DELAY) != pdTRUE) {
+                return ESP_ERR_TIMEOUT;
+            }
+
+            ota_fill_len = 0;
+        }
+
+        size_t copy_len = std::min(len, ota_buf_size - ota_fill_len);
+        memcpy(ota_fill_buf + ota_fill_len, buf, copy_len);
+        ota_fill_len += copy_len;
+        curr_ota_chunk_offset += copy_len;
+        buf += copy_len;
+        len -= copy_len;
+
+        if (ota_fill_len == ota_buf_size) {
+            flush_ota_fill();
+        }
+    }
+
+    return ESP_OK;
+}
+
+void tcfg_client::flush_ota_fill()
+{
+    if (ota_fill_buf == nullptr) {
+        return;
+    }
+
+    if (ota_fill_len == 0) {
+        discard_ota_fill();
+        return;
+    }
+
+    tcfg_client::ota_job job = {};
+    job.buf = ota_fill_buf;
+    job.len = ota_fill_len;
+    xQueueSend(ota_write_q, &job, portMAX_DELAY);
+    ota_fill_buf = nullptr;
+    ota_fill_len = 0;
+}
+
+void tcfg_client::discard_ota_fill()
+{
+    if (ota_fill_buf != nullptr) {
+        xQueueSend(ota_free_q, &ota_fill_buf, 0);
+    }
+
+    ota_fill_buf = nullptr;
+    ota_fill_len = 0;
+}
+
+bool tcfg_client::ota_inflate_sink::write_out(const uint8_t *buf, size_t len)
+{
+    ret = tcfg_client::instance()->feed_ota_payload(buf, len);
+    return ret == ESP_OK;
+}
+
+esp_err_t tcfg_client::handle_ota_commit()
+{
+    if (ota_handle == 0) {
+        ESP_LOGE(TAG, "OTA commit requested but not started!");
+        send_nack(ESP_ERR_INVALID_STATE);
+        reset_ota();
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    bool stream_ended = (ota_encoding == XFER_RAW || ota_inflate.finished()) && (!ota_delta || tcfg_delta::at_op_boundary(ota_patcher));
+    if (!stream_ended) {
+        ESP_LOGE(TAG, "OTA commit before the end of the deflate or delta stream");
+        discard_ota_fill();
+    } else {
+        flush_ota_fill();
+    }
+
+    auto ret = drain_ota_writes();
+    ret = ret ?: (stream_ended ? ESP_OK : ESP_ERR_INVALID_SIZE);
+    ota_inflate.end();
+    end_ota_delta();
+    end_ota_resume();
+
+    // esp_ota_end() releases the handle even when it fails, anything failing before it still holds one
+    if (ret != ESP_OK) {
+        esp_ota_abort(ota_handle);
+    } else {
+        ret = esp_ota_end(ota_handle);
+        ret = ret ?: esp_ota_set_boot_partition(curr_ota_part);
+    }
+
+    reset_ota();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "OTA failed to end! ret=%d %s", ret, esp_err_to_name(ret));
+        send_nack(ret);
+        return ret;
+    }
+
+    return send_ack();
+}
+
+esp_err_t tcfg_client::abort_ota()
+{
+    discard_ota_fill();
+    ota_inflate.end();
+    end_ota_delta();
+    drain_ota_writes();
+    end_ota_resume();
+
+    auto ret = esp_ota_abort(ota_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "OTA failed to abort! ret=%d %s", ret, esp_err_to_name(ret));
+    }
+
+    reset_ota();
+    return ret;
+}
+
+void tcfg_client::reset_ota()
+{
+    free_ota_bufs();
+    ota_handle = 0;
     curr_ota_part = nullptr;
     curr_ota_chunk_offset = 0;
-    return send_ack();
+}
+
+esp_err_t tcfg_client::alloc_ota_bufs()
+{
+    ota_buf_size = curr_wire->max_packet_size();
+    for (auto &ota_buf : ota_bufs) {
+        ota_buf = (uint8_t *)heap_caps_malloc(ota_buf_size, MALLOC_CAP_SPIRAM);
+        if (ota_buf == nullptr) {
+            free_ota_bufs();
+            return ESP_ERR_NO_MEM;
+        }
+
+        xQueueSend(ota_free_q, &ota_buf, 0);
+    }
+
+    return ESP_OK;
+}
+
+void tcfg_client::free_ota_bufs()
+{
+    // Only call this with the writer idle, i.e. after drain_ota_writes()
+    xQueueReset(ota_free_q);
+    for (auto &ota_buf : ota_bufs) {
+        heap_caps_free(ota_buf);
+        ota_buf = nullptr;
+    }
+}
+
+esp_err_t tcfg_client::drain_ota_writes(uint32_t wait_ticks)
+{
+    // The writer hands every buffer back once it's done with it, so holding all of them means it's idle
+    uint8_t *bufs[CONFIG_TC_OTA_QUEUE_DEPTH] = {};
+    size_t taken = 0;
+    while (taken < CONFIG_TC_OTA_QUEUE_DEPTH && xQueueReceive(ota_free_q, &bufs[taken], wait_ticks) == pdTRUE) {
+        taken += 1;
+    }
+
+    for (size_t idx = 0; idx < taken; idx += 1) {
+        xQueueSend(ota_free_q, &bufs[idx], 0);
+    }
+
+    if (taken < CONFIG_TC_OTA_QUEUE_DEPTH) {
+        ESP_LOGE(TAG, "OTA writer didn't drain in time");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ota_write_ret;
+}
+
+esp_err_t tcfg_client::load_xfer_checkpoint(const char *key, tcfg_client::xfer_checkpoint *ckpt_out)
+{
+    esp_err_t ret = ESP_OK;
+    auto nv = nvs::open_nvs_handle(XFER_NVS_NS, NVS_READONLY, &ret);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    size_t len = 0;
+    ret = nv->get_item_size(nvs::ItemType::BLOB, key, len);
+    ret = ret ?: (len == sizeof(tcfg_client::xfer_checkpoint) ? ESP_OK : ESP_ERR_INVALID_SIZE);
+    ret = ret ?: nv->get_blob(key, ckpt_out, sizeof(tcfg_client::xfer_checkpoint));
+    return ret;
+}
+
+esp_err_t tcfg_client::save_xfer_checkpoint(const char *key, const tcfg_client::xfer_checkpoint &ckpt)
+{
+    // Own handle rather than the namespace cache: the OTA writer task saves checkpoints too
+    esp_err_t ret = ESP_OK;
+    auto nv = nvs::open_nvs_handle(XFER_NVS_NS, NVS_READWRITE, &ret);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = nv->set_blob(key, &ckpt, sizeof(ckpt));
+    return ret ?: nv->commit();
+}
+
+void tcfg_client::clear_xfer_checkpoint(const char *key)
+{
+    esp_err_t ret = ESP_OK;
+    auto nv = nvs::open_nvs_handle(XFER_NVS_NS, NVS_READWRITE, &ret);
+    if (ret == ESP_OK && nv->erase_item(key) == ESP_OK) {
+        nv->commit();
+    }
 }
 
 esp_err_t tcfg_client::handle_uptime(uint64_t realtime_ms)
@@ -818,7 +3120,7 @@ esp_err_t tcfg_client::handle_uptime(uint64_t realtime_ms)
         tv.tv_sec = (time_t)(realtime_ms / 1000ULL);
         tv.tv_usec = (suseconds_t)((realtime_ms % 1000ULL) * 1000ULL);
 
-        ESP_LOGI(TAG, "Uptime: got epoch: %llu", realtime_ms);
+        ESP_LOGI(TAG, "Uptime: got epoch: %" PRIu64, realtime_ms);
         settimeofday(&tv, nullptr);
     }
 
@@ -2,12 +2,27 @@
 
 #include "tcfg_client.hpp"
 #include "tcfg_wire_interface.hpp"
+#include "tcfg_delta.hpp"
+#include "tcfg_hash_cache.hpp"
+#include "tcfg_buf_pool.hpp"
+#include "tcfg_inflate.hpp"
 #include <nvs.h>
 #include <nvs_flash.h>
+#include <nvs_handle.hpp>
 #include <esp_ota_ops.h>
+#include <spi_flash_mmap.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
+#include <atomic>
 
 #define TCFG_WIRE_MAX_PACKET_SIZE 4096
 
+// Where the data partition is mounted; the host build points it at a directory instead
+#ifndef TCFG_DATA_PATH
+#define TCFG_DATA_PATH "/data"
+#endif
+
 class tcfg_client
 {
 public:
@@ -37,10 +52,22 @@ public:
         PKT_SET_CONFIG = 0x11,
         PKT_DEL_CONFIG = 0x12,
         PKT_NUKE_CONFIG = 0x13,
+        PKT_GET_CONFIG_BATCH = 0x14,
+        PKT_SET_CONFIG_BATCH = 0x15,
+        PKT_LIST_CONFIG = 0x16,
+        PKT_EXPORT_CONFIG = 0x17,
+        PKT_IMPORT_CONFIG_BEGIN = 0x18,
+        PKT_IMPORT_CONFIG_CHUNK = 0x19,
         PKT_BEGIN_FILE_WRITE = 0x20,
         PKT_FILE_CHUNK = 0x21,
         PKT_GET_FILE_INFO = 0x22,
         PKT_DELETE_FILE = 0x23,
+        PKT_FILE_CHUNK_AT = 0x24,
+        PKT_FILE_READ = 0x25,
+        PKT_GET_FILE_SIG = 0x26,
+        PKT_BEGIN_FILE_PATCH = 0x27,
+        PKT_FILE_PATCH_CHUNK = 0x28,
+        PKT_FILE_SESSION_CHUNK = 0x29,
         PKT_BEGIN_OTA = 0x30,
         PKT_OTA_CHUNK = 0x31,
         PKT_OTA_COMMIT = 0x32,
@@ -53,6 +80,13 @@ public:
         PKT_DEV_INFO = 0x85,
         PKT_BIN_RPC_REPLY = 0x86,
         PKT_JSON_RPC_REPLY = 0x87,
+        PKT_CONFIG_BATCH_RESULT = 0x88,
+        PKT_CONFIG_BATCH_STATUS = 0x89,
+        PKT_CONFIG_LIST = 0x8a,
+        PKT_CONFIG_SNAPSHOT = 0x8b,
+        PKT_FILE_DATA = 0x8c,
+        PKT_FILE_SIG = 0x8d,
+        PKT_SESSION_CHUNK_ACK = 0x8e,
         PKT_NACK = 0xff,
     };
 
@@ -63,6 +97,7 @@ public:
         CHUNK_ERR_INTERNAL = 3,
         CHUNK_ERR_ABORT_REQUESTED = 4,
         CHUNK_ERR_NAME_TOO_LONG = 5,
+        CHUNK_ERR_HASH_MISMATCH = 6,
     };
 
     struct __attribute__((packed)) chunk_ack_pkt {
@@ -76,6 +111,32 @@ public:
         uint32_t aux_info;
     };
 
+    // Superset of chunk_ack_pkt, sent in reply to PKT_BEGIN_FILE_WRITE
+    struct __attribute__((packed)) file_begin_ack_pkt {
+        chunk_state state;
+        uint32_t aux_info; // Chunk offset to start from: 0, or where a resumed upload left off
+        uint16_t window; // Chunks the host may have in flight, 1 for stop-and-wait
+    };
+
+    // Superset of chunk_ack_pkt, replaces CHUNK_XFER_NEXT acks of compressed or delta transfers
+    struct __attribute__((packed)) chunk_progress_ack_pkt {
+        chunk_state state;
+        uint32_t aux_info; // Output (uncompressed, patched) bytes written so far
+        uint32_t stream_offset; // Wire bytes taken so far, i.e. where the host continues from
+    };
+
+    // Superset of chunk_ack_pkt, sent when an upload finishes with CHUNK_XFER_DONE or CHUNK_ERR_HASH_MISMATCH
+    struct __attribute__((packed)) file_done_ack_pkt {
+        chunk_state state;
+        uint32_t aux_info;
+        uint8_t hash[32]; // SHA256 of what was received
+    };
+
+    // PKT_SESSION_CHUNK_ACK: replaces PKT_CHUNK_ACK for uploads in a session other than 0, followed by the ack it stands for
+    struct __attribute__((packed)) session_ack_hdr {
+        uint8_t session;
+    };
+
     struct __attribute__((packed)) header {
         pkt_type type;
         uint16_t crc;
@@ -114,6 +175,82 @@ public:
         char path[UINT8_MAX];
     }; // 8 bytes
 
+    enum xfer_encoding : uint8_t {
+        XFER_RAW = 0,
+        XFER_DEFLATE = 1, // Raw deflate (RFC 1951), window no bigger than CONFIG_TC_INFLATE_DICT_SIZE
+    };
+
+    enum ota_begin_flag : uint8_t {
+        OTA_DELTA = BIT(0), // Chunks are tcfg_delta byte-range ops against the running image
+    };
+
+    // Optional payload of PKT_BEGIN_OTA
+    struct __attribute__((packed)) ota_begin_opts {
+        uint8_t encoding; // xfer_encoding, applied before the delta ops are parsed
+        uint8_t flags;
+        uint8_t base_hash[32]; // OTA_DELTA only: device_info_pkt::fw_hash the patch was made against
+        uint32_t xfer_id; // Non-zero to make the OTA resumable; begin then replies with a chunk ack carrying the offset to go on from
+    };
+
+    enum file_write_flag : uint8_t {
+        FILE_WRITE_VERIFY_SHA256 = BIT(0), // Delete the file and fail the upload if it doesn't match `hash`
+    };
+
+    // Optional, follows a full path_pkt in PKT_BEGIN_FILE_WRITE. Missing fields are treated as 0.
+    // Without options the path_pkt itself may end right after the path's terminator.
+    struct __attribute__((packed)) file_write_opts {
+        uint16_t window; // Requested number of PKT_FILE_CHUNK_AT in flight, 0 or 1 for stop-and-wait
+        uint8_t flags;
+        uint8_t hash[32];
+        uint8_t encoding; // xfer_encoding; the length in path_pkt stays the uncompressed one
+        uint32_t xfer_id; // Non-zero to make the upload resumable, beginning it again with the same ID picks up where it stopped
+        uint8_t session; // Uploads in different sessions can be interleaved; 0 is the one PKT_FILE_CHUNK(_AT) feed
+    };
+
+    struct __attribute__((packed)) file_chunk_pkt {
+        uint32_t offset;
+        uint8_t data[];
+    };
+
+    // PKT_FILE_SESSION_CHUNK: a PKT_FILE_CHUNK_AT for any session; no data aborts that session's upload
+    struct __attribute__((packed)) session_chunk_pkt {
+        uint8_t session;
+        uint32_t offset;
+        uint8_t data[];
+    };
+
+    // Replied with PKT_FILE_DATA stream chunks, offsets are file offsets
+    struct __attribute__((packed)) file_read_req_pkt {
+        uint32_t offset;
+        uint32_t len; // 0 to read until EOF
+        char path[UINT8_MAX];
+    };
+
+    // Replied with PKT_FILE_SIG stream chunks: a file_sig_hdr, then one file_block_sig per block
+    struct __attribute__((packed)) file_sig_req_pkt {
+        uint32_t block_size;
+        char path[UINT8_MAX];
+    };
+
+    struct __attribute__((packed)) file_sig_hdr {
+        uint32_t file_len;
+        uint32_t block_size;
+        uint32_t count;
+    };
+
+    struct __attribute__((packed)) file_block_sig {
+        uint32_t weak; // tcfg_delta::weak_sum()
+        uint8_t strong[32]; // SHA256
+    };
+
+    // Followed by PKT_FILE_PATCH_CHUNK stream chunks carrying tcfg_delta ops against the current file
+    struct __attribute__((packed)) file_patch_begin_pkt {
+        uint32_t block_size; // Must match the signatures the patch was made from
+        uint32_t out_len;
+        uint8_t hash[32]; // SHA256 of the patched file
+        char path[UINT8_MAX];
+    };
+
     struct __attribute__((packed)) cfg_pkt {
         nvs_type_t type : 8;
         uint16_t val_len;
@@ -122,6 +259,85 @@ public:
         uint8_t value[];
     };
 
+    struct __attribute__((packed)) cfg_key {
+        nvs_type_t type : 8;
+        char ns[16];
+        char key[16];
+    };
+
+    struct __attribute__((packed)) cfg_batch_req_pkt {
+        uint16_t count;
+        cfg_key keys[];
+    };
+
+    enum cfg_batch_flag : uint8_t {
+        CFG_BATCH_LAST = BIT(0),
+    };
+
+    // PKT_CONFIG_BATCH_RESULT: followed by `count` entries, each a cfg_batch_entry then a cfg_pkt with its value
+    struct __attribute__((packed)) cfg_batch_result_pkt {
+        uint16_t count;
+        uint8_t flags;
+    };
+
+    struct __attribute__((packed)) cfg_batch_entry {
+        uint16_t idx; // Position in the request's key list
+        int32_t ret;
+    };
+
+    // Followed by `count` cfg_pkt records back to back, each with its value. Validated up front, not transactional:
+    // a malformed record leaves NVS untouched, but a write failing partway leaves the records before it applied.
+    struct __attribute__((packed)) cfg_set_batch_req_pkt {
+        uint16_t count;
+        uint8_t records[];
+    };
+
+    struct __attribute__((packed)) cfg_batch_status_pkt {
+        int32_t ret;
+        uint16_t fail_idx; // First record that failed, UINT16_MAX if all went through; the ones before it are applied
+    };
+
+    struct __attribute__((packed)) list_cfg_req_pkt {
+        char ns[16]; // Empty for every namespace
+    };
+
+    enum stream_flag : uint8_t {
+        STREAM_LAST = BIT(0),
+    };
+
+    // PKT_CONFIG_LIST: followed by `count` cfg_pkt records, each with its value; the stream ends with STREAM_LAST in `flags`
+    struct __attribute__((packed)) cfg_list_pkt {
+        uint16_t count;
+        uint8_t flags; // stream_flag
+        uint16_t skipped; // Final frame only: entries left out, e.g. blobs that don't fit in a frame
+    };
+
+    // Carries a slice of a byte stream that's too big for one frame, e.g. PKT_CONFIG_SNAPSHOT
+    struct __attribute__((packed)) stream_chunk_pkt {
+        uint32_t offset;
+        uint8_t flags;
+        uint8_t data[];
+    };
+
+    static const constexpr uint32_t CFG_SNAPSHOT_MAGIC = 0x50414e53; // "SNAP"
+    static const constexpr uint8_t CFG_SNAPSHOT_VERSION = 1;
+
+    // Config snapshot image: this header, `count` cfg_pkt records with values grouped by namespace, then cfg_snapshot_trailer
+    struct __attribute__((packed)) cfg_snapshot_hdr {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t reserved;
+        uint16_t count;
+    };
+
+    struct __attribute__((packed)) cfg_snapshot_trailer {
+        uint32_t crc; // CRC32 (zlib) of everything before the trailer
+    };
+
+    struct __attribute__((packed)) cfg_import_begin_pkt {
+        uint32_t len; // Whole image, trailer included
+    };
+
     struct __attribute__((packed)) del_cfg_pkt {
         char ns[16];
         char key[16];
@@ -132,13 +348,42 @@ public:
         uint8_t hash[32];
     };
 
+    // NVS record (XFER_NVS_NS) that lets an interrupted transfer pick up again after a reboot
+    struct __attribute__((packed)) xfer_checkpoint {
+        uint32_t xfer_id;
+        uint32_t total_len; // File uploads only
+        uint32_t part_addr; // OTA only: the update partition it was going into
+        uint32_t committed; // Bytes known to be on flash
+        uint8_t hash[32]; // SHA256 of those bytes
+        char path[UINT8_MAX + 1];
+    };
+
+    struct nvs_cache_stats {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+    };
+
 public:
+    // Call once per wire; each gets its own receive task, and replies go back out the wire the request came in on
     esp_err_t init(tcfg_wire_if *_wire_if);
+    tcfg_client::nvs_cache_stats get_nvs_cache_stats() const;
+    tcfg_buf_pool::stats get_pkt_pool_stats() const;
+    esp_err_t flush_nvs_cache();
+    // Writes out file hash cache changes still held back by CONFIG_TC_FILE_HASH_CACHE_SAVE_INTERVAL_MS, e.g. before a reboot
+    esp_err_t flush_hash_cache();
 
 private:
     tcfg_client() = default;
+    esp_err_t init_shared();
     static void rx_task(void *_ctx);
-    void handle_rx_pkt(const uint8_t *buf, size_t decoded_len);
+    static void ota_write_task(void *_ctx);
+    void handle_rx_pkt(const uint8_t *buf, size_t decoded_len, uint16_t frame_crc);
+    SemaphoreHandle_t lock_for(uint8_t type) const;
+    static size_t min_payload_len(uint8_t type);
+    static bool cfg_names_valid(const char *ns, const char *key);
+    static bool read_path_pkt(const uint8_t *payload, size_t len, tcfg_client::path_pkt *pkt_out);
+    void dispatch_pkt(const uint8_t *buf);
 
 private:
     static uint16_t get_crc16(const uint8_t *buf, size_t len, uint16_t init = 0);
@@ -150,32 +395,227 @@ private:
     esp_err_t encode_and_tx(const uint8_t *header_buf, size_t header_len, const uint8_t *buf, size_t len, uint32_t timeout_ticks = portMAX_DELAY);
 
 private:
+    struct file_xfer;
     esp_err_t set_cfg_to_nvs(const char *ns, const char *key, nvs_type_t type, const void *value, size_t value_len);
     esp_err_t get_cfg_from_nvs(const char *ns, const char *key, nvs_type_t type);
+    esp_err_t get_cfg_batch(const tcfg_client::cfg_key *keys, uint16_t count);
+    esp_err_t list_cfg(const char *ns);
+    esp_err_t export_cfg_snapshot();
+    esp_err_t build_cfg_snapshot(uint8_t *buf, size_t cap, size_t *len_out);
+    esp_err_t handle_import_begin(size_t len);
+    esp_err_t handle_import_chunk(uint32_t offset, const uint8_t *buf, size_t len);
+    esp_err_t apply_cfg_snapshot(const uint8_t *buf, size_t len, uint16_t *fail_idx_out);
+    esp_err_t send_stream(pkt_type type, const uint8_t *buf, size_t len);
+    esp_err_t set_cfg_batch(const uint8_t *buf, size_t len, uint16_t count);
+    esp_err_t apply_cfg_records(const uint8_t *buf, size_t len, uint16_t count, uint16_t *fail_idx_out);
+    static const tcfg_client::cfg_pkt *next_cfg_record(const uint8_t *buf, size_t len, size_t *pos);
+    static esp_err_t write_cfg_value(nvs::NVSHandle &nv, const char *key, nvs_type_t type, const void *value, size_t value_len);
+    static esp_err_t read_cfg_value(nvs::NVSHandle &nv, const char *key, nvs_type_t type, uint8_t *val_out, size_t val_cap, uint16_t *val_len_out);
     esp_err_t delete_cfg(const char *ns, const char *key);
     esp_err_t nuke_cfg(const char *ns);
-    esp_err_t handle_begin_file_write(const char *path, size_t expect_len);
+    nvs::NVSHandle *get_nvs_handle(const char *ns, bool create, esp_err_t *ret_out);
+    void evict_nvs_handle(const char *ns);
+    esp_err_t commit_nvs_cache();
+    esp_err_t handle_begin_file_write(const char *path, size_t expect_len, const tcfg_client::file_write_opts &opts);
+    esp_err_t resume_file_xfer(tcfg_client::file_xfer &xfer, const char *path, size_t expect_len, uint32_t xfer_id);
+    void checkpoint_file_xfer(tcfg_client::file_xfer &xfer, size_t committed);
+    tcfg_client::file_xfer *find_file_xfer(uint8_t session);
     esp_err_t handle_file_chunk(const uint8_t *buf, uint16_t len);
+    esp_err_t handle_file_chunk_at(uint8_t session, uint32_t offset, const uint8_t *buf, uint16_t len);
+    esp_err_t store_file_data(tcfg_client::file_xfer &xfer, const uint8_t *buf, size_t len);
+    esp_err_t write_file_data(tcfg_client::file_xfer &xfer, const uint8_t *buf, size_t len);
+    esp_err_t flush_file_wb(tcfg_client::file_xfer &xfer);
+    esp_err_t finish_file_xfer(tcfg_client::file_xfer &xfer);
+    void close_file_xfer(tcfg_client::file_xfer &xfer);
+    esp_err_t handle_file_read(const char *path, uint32_t offset, uint32_t len);
+    esp_err_t handle_get_file_sig(const char *path, uint32_t block_size);
+    esp_err_t handle_begin_file_patch(const tcfg_client::file_patch_begin_pkt &req);
+    esp_err_t handle_file_patch_chunk(uint32_t offset, uint8_t flags, const uint8_t *buf, size_t len);
+    esp_err_t finish_file_patch();
+    void close_file_patch(bool discard);
+    static esp_err_t sha256_file(FILE *fp, uint8_t *hash_out, size_t *len_out);
+    static esp_err_t sha256_snapshot(const mbedtls_sha256_context *sha, uint8_t *hash_out);
+    static esp_err_t hash_file_prefix(FILE *fp, size_t len, mbedtls_sha256_context *sha);
+    static esp_err_t hash_partition_prefix(const esp_partition_t *part, size_t len, mbedtls_sha256_context *sha);
     esp_err_t handle_file_delete(const char *path);
     esp_err_t handle_get_file_info(const char *path);
-    esp_err_t handle_ota_begin();
+    esp_err_t send_xfer_ack(uint8_t session, const void *pkt, size_t len);
+    esp_err_t send_xfer_state(uint8_t session, tcfg_client::chunk_state state, uint32_t aux = 0);
+    esp_err_t send_xfer_progress(uint8_t session, bool transformed, uint32_t offset, uint32_t stream_offset);
+    esp_err_t handle_ota_begin(const tcfg_client::ota_begin_opts &opts);
     esp_err_t handle_ota_chunk(const uint8_t *buf, uint16_t len);
+    esp_err_t feed_ota_payload(const uint8_t *buf, size_t len);
+    esp_err_t store_ota_data(const uint8_t *buf, size_t len);
+    esp_err_t store_ota_base(uint32_t offset, const uint8_t *diff, size_t len);
+    void end_ota_delta();
+    esp_err_t resume_ota(uint32_t xfer_id);
+    void track_ota_written(const uint8_t *buf, size_t len);
+    void end_ota_resume();
+    void flush_ota_fill();
+    void discard_ota_fill();
     esp_err_t handle_ota_commit();
+    esp_err_t abort_ota(); // Tears down an OTA in progress, esp_ota handle included
+    void reset_ota();
+    esp_err_t alloc_ota_bufs();
+    void free_ota_bufs();
+    esp_err_t drain_ota_writes(uint32_t wait_ticks = portMAX_DELAY);
+    static esp_err_t load_xfer_checkpoint(const char *key, tcfg_client::xfer_checkpoint *ckpt_out);
+    static esp_err_t save_xfer_checkpoint(const char *key, const tcfg_client::xfer_checkpoint &ckpt);
+    static void clear_xfer_checkpoint(const char *key);
     esp_err_t handle_uptime(uint64_t realtime_ms);
 
 private:
-    FILE *fp = nullptr;
-    size_t file_expect_len = 0;
-    tcfg_wire_if *wire_if = nullptr;
+    struct wire_slot {
+        tcfg_wire_if *wire = nullptr;
+        TaskHandle_t rx_task = nullptr;
+    };
+
+    struct ota_job {
+        uint8_t *buf;
+        size_t len;
+    };
+
+    struct nvs_cache_entry {
+        char ns[17];
+        std::unique_ptr<nvs::NVSHandle> handle;
+        uint32_t last_used;
+    };
+
+    struct cfg_import {
+        uint8_t *buf = nullptr;
+        size_t len = 0;
+        size_t offset = 0;
+    };
+
+    struct file_xfer {
+        FILE *fp = nullptr;
+        size_t expect_len = 0;
+        size_t offset = 0;
+        size_t stream_offset = 0; // Same as offset unless compressed
+        uint8_t encoding = XFER_RAW;
+        uint16_t window = 1;
+        uint16_t unacked = 0;
+        bool gap_acked = false;
+        bool verify = false;
+        char path[UINT8_MAX + 1] = {};
+        uint8_t expect_hash[32] = {};
+        mbedtls_sha256_context sha = {};
+        uint8_t *wb_buf = nullptr; // Write-behind buffer, flushed in whole FILE_WB_SIZE blocks
+        size_t wb_len = 0;
+        uint32_t xfer_id = 0;
+        size_t next_ckpt = 0; // Offset of the next NVS checkpoint, 0 when not checkpointing
+        char ckpt_key[NVS_KEY_NAME_MAX_SIZE] = {};
+        uint8_t session = 0;
+        tcfg_inflate inflate;
+    };
+
+    // Decompressed data goes into the same write paths as raw chunks
+    class file_inflate_sink : public tcfg_inflate::sink
+    {
+    public:
+        bool write_out(const uint8_t *buf, size_t len) override;
+        tcfg_client::file_xfer *xfer = nullptr;
+        esp_err_t ret = ESP_OK;
+    };
+
+    class ota_inflate_sink : public tcfg_inflate::sink
+    {
+    public:
+        bool write_out(const uint8_t *buf, size_t len) override;
+        esp_err_t ret = ESP_OK;
+    };
+
+    // Applies a firmware delta: old bytes come from the running partition, everything goes out through store_ota_data()
+    class ota_patch_sink : public tcfg_delta::sink
+    {
+    public:
+        bool copy_blocks(uint32_t block, uint32_t count) override;
+        bool write_literal(const uint8_t *buf, size_t len) override;
+        bool copy_range(uint32_t offset, uint32_t len) override;
+        bool add_range(uint32_t offset, const uint8_t *diff, size_t len) override;
+        esp_err_t ret = ESP_OK;
+    };
+
+    // Rebuilds a file from its old version plus a tcfg_delta op stream, into a temp file next to it
+    class file_patch : public tcfg_delta::sink
+    {
+    public:
+        bool copy_blocks(uint32_t block, uint32_t count) override;
+        bool write_literal(const uint8_t *buf, size_t len) override;
+
+    public:
+        FILE *src_fp = nullptr;
+        FILE *dst_fp = nullptr;
+        uint8_t *copy_buf = nullptr;
+        size_t src_len = 0;
+        size_t block_size = 0;
+        size_t out_len = 0;
+        size_t written = 0;
+        size_t stream_offset = 0;
+        uint8_t expect_hash[32] = {};
+        char path[UINT8_MAX + 1] = {};
+        char tmp_path[UINT8_MAX + 5] = {};
+        tcfg_delta::patcher parser = {};
+    };
+
+private:
+    tcfg_client::file_xfer file_xfers[CONFIG_TC_FILE_MAX_SESSIONS] = {}; // One per session, slot is free while fp is null
+    tcfg_client::file_patch patch_ctx = {};
+    tcfg_hash_cache hash_cache = {};
+    tcfg_buf_pool pkt_pool;
+    tcfg_client::cfg_import import_ctx = {};
+    tcfg_client::wire_slot wires[CONFIG_TC_MAX_WIRES] = {};
+    static thread_local tcfg_wire_if *curr_wire; // Set by each rx task to its own wire
+    SemaphoreHandle_t cfg_lock = nullptr; // NVS handle cache, config import
+    SemaphoreHandle_t file_lock = nullptr; // Upload sessions, file patch, hash cache
+    SemaphoreHandle_t ota_lock = nullptr;
     EventGroupHandle_t state_evt_group = nullptr;
-    TaskHandle_t rx_task_handle = nullptr;
     esp_ota_handle_t ota_handle = 0;
     uint32_t curr_ota_chunk_offset = 0;
     const esp_partition_t *curr_ota_part = nullptr;
+    TaskHandle_t ota_task_handle = nullptr;
+    QueueHandle_t ota_free_q = nullptr; // Empty PSRAM chunk buffers
+    QueueHandle_t ota_write_q = nullptr; // ota_job waiting for esp_ota_write()
+    uint8_t *ota_bufs[CONFIG_TC_OTA_QUEUE_DEPTH] = {};
+    size_t ota_buf_size = 0;
+    uint8_t *ota_fill_buf = nullptr; // Taken from ota_free_q, filling up before it goes to ota_write_q
+    size_t ota_fill_len = 0;
+    uint8_t ota_encoding = XFER_RAW;
+    uint32_t ota_stream_offset = 0;
+    tcfg_inflate ota_inflate;
+    bool ota_delta = false;
+    const esp_partition_t *ota_base_part = nullptr; // Running image a delta OTA reads from
+    uint8_t *ota_base_buf = nullptr;
+    tcfg_delta::patcher ota_patcher = {};
+    uint32_t ota_xfer_id = 0;
+    mbedtls_sha256_context ota_sha = {}; // Everything esp_ota_write() has taken, while checkpointing
+    uint32_t ota_written = 0; // Writer task only
+    uint32_t ota_next_ckpt = 0; // 0 when not checkpointing
+    std::atomic<esp_err_t> ota_write_ret = ESP_OK; // First esp_ota_write() failure, sticky until next begin
     tcfg_client::device_info_pkt dev_info = {};
+    tcfg_client::nvs_cache_entry nvs_cache[CONFIG_TC_NVS_CACHE_SIZE] = {};
+    tcfg_client::nvs_cache_stats nvs_stats = {};
+    uint32_t nvs_cache_tick = 0;
 
 private:
     static const constexpr char TAG[] = "tcfg";
-    static const constexpr char BASE_PATH[] = "/data";
+    static const constexpr char BASE_PATH[] = TCFG_DATA_PATH;
+    static const constexpr char HASH_CACHE_PATH[] = TCFG_DATA_PATH "/.tcfg_hash";
+    static const constexpr size_t HASH_BUF_SIZE = 16384;
+    static const constexpr size_t PKT_BUF_SIZE = TCFG_WIRE_MAX_PACKET_SIZE;
+#ifdef CONFIG_TC_PKT_POOL_IN_PSRAM
+    static const constexpr bool PKT_POOL_IN_PSRAM = true;
+#else
+    static const constexpr bool PKT_POOL_IN_PSRAM = false;
+#endif
+    static const constexpr size_t OTA_BASE_BUF_SIZE = 4096;
+    static const constexpr char XFER_NVS_NS[] = "tcfg_xfer";
+    static const constexpr char XFER_KEY_FILE[] = "file";
+    static const constexpr char XFER_KEY_OTA[] = "ota";
+    static const constexpr size_t XFER_CKPT_INTERVAL = CONFIG_TC_XFER_CHECKPOINT_INTERVAL / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    static const constexpr size_t FILE_WB_SIZE = CONFIG_TC_FILE_WRITE_BUF_SIZE / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    static const constexpr size_t MAX_BATCH_KEYS = 256; // A full 8 KiB frame of cfg_key is ~248
+    static const constexpr size_t MIN_DELTA_BLOCK_SIZE = 64;
+    static const constexpr size_t MAX_DELTA_BLOCK_SIZE = 65536;
 };
 
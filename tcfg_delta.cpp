@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstring>
+#include "tcfg_delta.hpp"
+
+void tcfg_delta::reset(tcfg_delta::patcher &p)
+{
+    p = {};
+}
+
+size_t tcfg_delta::op_size(uint8_t op)
+{
+    switch (op) {
+        case OP_COPY: {
+            return sizeof(copy_op);
+        }
+
+        case OP_LITERAL: {
+            return sizeof(literal_op);
+        }
+
+        case OP_COPY_RANGE:
+        case OP_ADD: {
+            return sizeof(range_op);
+        }
+
+        default: {
+            return 0;
+        }
+    }
+}
+
+bool tcfg_delta::feed(tcfg_delta::patcher &p, const uint8_t *in, size_t len, tcfg_delta::sink &out)
+{
+    size_t pos = 0;
+    while (!p.failed && pos < len) {
+        if (p.data_left > 0) {
+            size_t run_len = std::min<size_t>(p.data_left, len - pos);
+            if (p.data_op == OP_ADD) {
+                p.failed = !out.add_range(p.data_offset, in + pos, run_len);
+                p.data_offset += run_len;
+            } else {
+                p.failed = !out.write_literal(in + pos, run_len);
+            }
+
+            p.data_left -= run_len;
+            pos += run_len;
+            continue;
+        }
+
+        if (p.op_len == 0 && op_size(in[pos]) == 0) {
+            p.failed = true;
+            break;
+        }
+
+        size_t want = op_size(p.op_len > 0 ? p.op_buf[0] : in[pos]) - p.op_len;
+        size_t take = std::min(want, len - pos);
+        memcpy(p.op_buf + p.op_len, in + pos, take);
+        p.op_len += take;
+        pos += take;
+        if (take < want) {
+            break; // Rest of the op header is in the next slice
+        }
+
+        p.op_len = 0;
+        switch (p.op_buf[0]) {
+            case OP_COPY: {
+                copy_op op = {};
+                memcpy(&op, p.op_buf, sizeof(op));
+                p.failed = op.count == 0 || !out.copy_blocks(op.block, op.count);
+                break;
+            }
+
+            case OP_LITERAL: {
+                literal_op op = {};
+                memcpy(&op, p.op_buf, sizeof(op));
+                p.data_op = OP_LITERAL;
+                p.data_left = op.len;
+                break;
+            }
+
+            case OP_COPY_RANGE: {
+                range_op op = {};
+                memcpy(&op, p.op_buf, sizeof(op));
+                p.failed = !out.copy_range(op.offset, op.len);
+                break;
+            }
+
+            default: { // OP_ADD
+                range_op op = {};
+                memcpy(&op, p.op_buf, sizeof(op));
+                p.data_op = OP_ADD;
+                p.data_left = op.len;
+                p.data_offset = op.offset;
+                break;
+            }
+        }
+    }
+
+    return !p.failed;
+}
+
+bool tcfg_delta::at_op_boundary(const tcfg_delta::patcher &p)
+{
+    return !p.failed && p.op_len == 0 && p.data_left == 0;
+}
+
+uint32_t tcfg_delta::weak_sum(const uint8_t *buf, size_t len)
+{
+    uint32_t a = 0;
+    uint32_t b = 0;
+    for (size_t idx = 0; idx < len; idx += 1) {
+        a += buf[idx];
+        b += (uint32_t)(len - idx) * buf[idx];
+    }
+
+    return (a & 0xffff) | (b << 16);
+}
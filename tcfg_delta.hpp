@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// rsync-style block delta (per-block weak checksums, block copies) and bsdiff-style byte-range ops, with a streaming op parser.
+// Kept free of ESP-IDF headers so the host side can share it.
+class tcfg_delta
+{
+public:
+    enum patch_op : uint8_t {
+        OP_COPY = 1, // Copy `count` blocks of the old file starting at `block`
+        OP_LITERAL = 2, // Followed by `len` bytes of new data
+        OP_COPY_RANGE = 3, // Copy `len` bytes of the old data from byte `offset`
+        OP_ADD = 4, // Followed by `len` bytes, each added (mod 256) to the old byte at `offset` + i, as in bsdiff
+    };
+
+    struct __attribute__((packed)) copy_op {
+        patch_op op;
+        uint32_t block;
+        uint32_t count;
+    };
+
+    struct __attribute__((packed)) literal_op {
+        patch_op op;
+        uint32_t len;
+    };
+
+    struct __attribute__((packed)) range_op {
+        patch_op op;
+        uint32_t offset;
+        uint32_t len;
+    };
+
+    // Where parsed ops go; returning false stops the patch
+    class sink
+    {
+    public:
+        virtual ~sink() = default;
+        virtual bool copy_blocks(uint32_t block, uint32_t count) = 0;
+        virtual bool write_literal(const uint8_t *buf, size_t len) = 0;
+
+        // Byte-range ops, for sinks that can read the old data at any offset
+        virtual bool copy_range(uint32_t offset, uint32_t len)
+        {
+            (void)offset;
+            (void)len;
+            return false;
+        }
+
+        virtual bool add_range(uint32_t offset, const uint8_t *diff, size_t len)
+        {
+            (void)offset;
+            (void)diff;
+            (void)len;
+            return false;
+        }
+    };
+
+    struct patcher {
+        uint8_t op_buf[sizeof(range_op)] = {}; // Op header, may arrive split across chunks
+        size_t op_len = 0;
+        uint8_t data_op = 0; // OP_LITERAL or OP_ADD while data_left > 0
+        uint32_t data_left = 0;
+        uint32_t data_offset = 0; // Old data offset for the next OP_ADD byte
+        bool failed = false;
+    };
+
+public:
+    static void reset(patcher &p);
+
+    // Feed the next slice of the op stream. Returns false once an op is malformed or the sink refused it.
+    static bool feed(patcher &p, const uint8_t *in, size_t len, sink &out);
+
+    // True when the stream so far ends on an op boundary
+    static bool at_op_boundary(const patcher &p);
+
+    // rsync weak checksum: low 16 bits are the byte sum, high 16 bits the position-weighted sum
+    static uint32_t weak_sum(const uint8_t *buf, size_t len);
+
+private:
+    static size_t op_size(uint8_t op);
+};
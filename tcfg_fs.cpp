@@ -0,0 +1,40 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <unistd.h>
+#include <esp_log.h>
+#include "tcfg_fs.hpp"
+
+esp_err_t tcfg_fs::replace_file(const char *tmp_path, const char *path)
+{
+    if (rename(tmp_path, path) == 0) {
+        return ESP_OK;
+    }
+
+    char bak_path[UINT8_MAX + 5] = {};
+    if (snprintf(bak_path, sizeof(bak_path), "%s.bak", path) >= (int)sizeof(bak_path)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // path is still there, so a .bak left by an earlier replace is stale
+    unlink(bak_path);
+    if (rename(path, bak_path) != 0) {
+        ESP_LOGE(TAG, "Can't move %s aside, errno %d", path, errno);
+        return ESP_FAIL;
+    }
+
+    if (rename(tmp_path, path) != 0) {
+        ESP_LOGE(TAG, "Can't move %s into place, errno %d", tmp_path, errno);
+        if (rename(bak_path, path) != 0) {
+            ESP_LOGE(TAG, "Can't restore %s, old copy left in %s", path, bak_path);
+        }
+
+        return ESP_FAIL;
+    }
+
+    if (unlink(bak_path) != 0) {
+        ESP_LOGW(TAG, "Can't delete %s, errno %d", bak_path, errno);
+    }
+
+    return ESP_OK;
+}
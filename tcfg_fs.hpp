@@ -0,0 +1,16 @@
+#pragma once
+
+#include <esp_err.h>
+
+// File system helpers shared by tcfg_client and tcfg_hash_cache
+class tcfg_fs
+{
+public:
+    // Moves tmp_path over path. Not every VFS renames over an existing file (FATFS doesn't): there the old file is
+    // renamed to path + ".bak" first and only deleted once tmp_path is in place, and put back if that fails. Power lost
+    // in between leaves the old file as the .bak, never no file at all.
+    static esp_err_t replace_file(const char *tmp_path, const char *path);
+
+private:
+    static const constexpr char TAG[] = "tcfg_fs";
+};
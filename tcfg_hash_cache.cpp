@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <esp_log.h>
+#include <esp_crc.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include "tcfg_hash_cache.hpp"
+#include "tcfg_fs.hpp"
+
+esp_err_t tcfg_hash_cache::init(const char *_cache_path, size_t _capacity, uint32_t save_interval_ms)
+{
+    if (_cache_path == nullptr || strlen(_cache_path) + 4 >= sizeof(cache_path)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    snprintf(cache_path, sizeof(cache_path), "%s", _cache_path);
+    capacity = std::min<size_t>(_capacity, UINT16_MAX);
+    save_interval_us = (int64_t)save_interval_ms * 1000;
+    if (capacity == 0) {
+        return ESP_OK;
+    }
+
+    entries = (tcfg_hash_cache::entry *)heap_caps_calloc(capacity, sizeof(tcfg_hash_cache::entry), MALLOC_CAP_SPIRAM);
+    if (entries == nullptr) {
+        capacity = 0;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void tcfg_hash_cache::load()
+{
+    loaded = true;
+    FILE *fp = fopen(cache_path, "rb");
+    if (fp == nullptr) {
+        return; // First boot, or nothing cached yet
+    }
+
+    tcfg_hash_cache::file_hdr hdr = {};
+    uint32_t crc = 0;
+    size_t read_count = 0;
+    bool valid = fread(&hdr, sizeof(hdr), 1, fp) == 1 && hdr.magic == FILE_MAGIC && hdr.version == FILE_VERSION;
+    if (valid) {
+        // A file from a build with a bigger capacity is dropped rather than half-read
+        read_count = fread(entries, sizeof(tcfg_hash_cache::entry), std::min<size_t>(hdr.count, capacity), fp);
+        valid = read_count == hdr.count && fread(&crc, sizeof(crc), 1, fp) == 1;
+    }
+
+    fclose(fp);
+
+    if (valid) {
+        uint32_t actual_crc = esp_crc32_le(0, (const uint8_t *)&hdr, sizeof(hdr));
+        actual_crc = esp_crc32_le(actual_crc, (const uint8_t *)entries, read_count * sizeof(tcfg_hash_cache::entry));
+        valid = actual_crc == crc;
+    }
+
+    if (!valid) {
+        ESP_LOGW(TAG, "Hash cache %s unusable, starting empty", cache_path);
+        memset(entries, 0, capacity * sizeof(tcfg_hash_cache::entry));
+        count = 0;
+        return;
+    }
+
+    count = read_count;
+    ESP_LOGI(TAG, "Loaded %zu cached file hashes", count);
+}
+
+esp_err_t tcfg_hash_cache::save()
+{
+    char tmp_path[sizeof(cache_path)] = {};
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path) >= (int)sizeof(tmp_path)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp == nullptr) {
+        return ESP_FAIL;
+    }
+
+    tcfg_hash_cache::file_hdr hdr = {};
+    hdr.magic = FILE_MAGIC;
+    hdr.version = FILE_VERSION;
+    hdr.count = count;
+
+    uint32_t crc = esp_crc32_le(0, (const uint8_t *)&hdr, sizeof(hdr));
+    crc = esp_crc32_le(crc, (const uint8_t *)entries, count * sizeof(tcfg_hash_cache::entry));
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    ok = ok && fwrite(entries, sizeof(tcfg_hash_cache::entry), count, fp) == count;
+    ok = ok && fwrite(&crc, sizeof(crc), 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+
+    ok = ok && tcfg_fs::replace_file(tmp_path, cache_path) == ESP_OK;
+
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to save hash cache to %s", cache_path);
+        unlink(tmp_path);
+        return ESP_FAIL;
+    }
+
+    dirty = false;
+    last_save_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+esp_err_t tcfg_hash_cache::save_if_due()
+{
+    // Every save rewrites the whole file through a temp copy, so an upload (invalidate, then store) or a burst of
+    // PKT_GET_FILE_INFO misses shares one instead of paying for its own
+    dirty = true;
+    if (last_save_us != 0 && esp_timer_get_time() - last_save_us < save_interval_us) {
+        return ESP_OK;
+    }
+
+    return save();
+}
+
+esp_err_t tcfg_hash_cache::flush()
+{
+    return dirty ? save() : ESP_OK;
+}
+
+tcfg_hash_cache::entry *tcfg_hash_cache::find(const char *path)
+{
+    if (!loaded && capacity > 0) {
+        load();
+    }
+
+    for (size_t idx = 0; idx < count; idx += 1) {
+        if (strncmp(entries[idx].path, path, sizeof(entries[idx].path)) == 0) {
+            // Move to the front, so the tail is always the eviction candidate
+            tcfg_hash_cache::entry hit = entries[idx];
+            memmove(&entries[1], &entries[0], idx * sizeof(tcfg_hash_cache::entry));
+            entries[0] = hit;
+            return &entries[0];
+        }
+    }
+
+    return nullptr;
+}
+
+bool tcfg_hash_cache::lookup(const char *path, size_t size, int64_t mtime, uint8_t *hash_out)
+{
+    if (path == nullptr || capacity == 0) {
+        return false;
+    }
+
+    auto *hit = find(path);
+    if (hit == nullptr || hit->size != size || hit->mtime != mtime) {
+        return false;
+    }
+
+    memcpy(hash_out, hit->hash, HASH_LEN);
+    return true;
+}
+
+esp_err_t tcfg_hash_cache::store(const char *path, size_t size, int64_t mtime, const uint8_t *hash)
+{
+    if (path == nullptr || hash == nullptr || strlen(path) >= sizeof(entry::path)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (capacity == 0) {
+        return ESP_OK;
+    }
+
+    auto *slot = find(path);
+    if (slot == nullptr) {
+        count = std::min(count + 1, capacity); // Full: the least recently used one falls off the end
+        memmove(&entries[1], &entries[0], (count - 1) * sizeof(tcfg_hash_cache::entry));
+        slot = &entries[0];
+    }
+
+    memset(slot, 0, sizeof(tcfg_hash_cache::entry));
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    slot->size = size;
+    slot->mtime = mtime;
+    memcpy(slot->hash, hash, HASH_LEN);
+    return save_if_due();
+}
+
+esp_err_t tcfg_hash_cache::invalidate(const char *path)
+{
+    if (path == nullptr || capacity == 0 || find(path) == nullptr) {
+        return ESP_OK;
+    }
+
+    // find() put it at the front
+    count -= 1;
+    memmove(&entries[0], &entries[1], count * sizeof(tcfg_hash_cache::entry));
+    return save_if_due();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <esp_err.h>
+
+// (path, size, mtime) -> SHA256 for files on the data partition, persisted next to them. Only as good as mtime, which is
+// 2 s coarse on FAT: same-size rewrites that bypass invalidate() within that window go unnoticed.
+class tcfg_hash_cache
+{
+public:
+    static const constexpr size_t HASH_LEN = 32;
+
+    // Loads lazily from cache_path on first use. Changes are written back at most once per save_interval_ms,
+    // the rest wait in RAM until flush() or a later change; 0 writes every change straight away.
+    esp_err_t init(const char *cache_path, size_t capacity, uint32_t save_interval_ms);
+    bool lookup(const char *path, size_t size, int64_t mtime, uint8_t *hash_out);
+    esp_err_t store(const char *path, size_t size, int64_t mtime, const uint8_t *hash);
+    esp_err_t invalidate(const char *path);
+    esp_err_t flush();
+
+private:
+    static const constexpr uint32_t FILE_MAGIC = 0x48534854; // "THSH"
+    static const constexpr uint16_t FILE_VERSION = 1;
+
+    struct __attribute__((packed)) file_hdr {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t count;
+    };
+
+    struct __attribute__((packed)) entry {
+        char path[UINT8_MAX + 1];
+        uint32_t size;
+        int64_t mtime;
+        uint8_t hash[HASH_LEN];
+    };
+
+    // File layout: file_hdr, `count` entries, then a CRC32 of both
+
+private:
+    void load();
+    esp_err_t save();
+    esp_err_t save_if_due();
+    tcfg_hash_cache::entry *find(const char *path);
+
+private:
+    tcfg_hash_cache::entry *entries = nullptr; // Most recently used first
+    size_t count = 0;
+    size_t capacity = 0;
+    bool loaded = false;
+    bool dirty = false;
+    int64_t save_interval_us = 0;
+    int64_t last_save_us = 0;
+    char cache_path[UINT8_MAX + 1] = {};
+
+private:
+    static const constexpr char TAG[] = "tcfg_hash";
+};
@@ -0,0 +1,157 @@
+#include <cstdlib>
+#include "tcfg_inflate.hpp"
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#include <rom/miniz.h>
+#else
+#include <zlib.h>
+#endif
+
+tcfg_inflate::~tcfg_inflate()
+{
+    end();
+}
+
+bool tcfg_inflate::begin(size_t _dict_size)
+{
+    end();
+    if (_dict_size == 0 || (_dict_size & (_dict_size - 1)) != 0) {
+        return false;
+    }
+
+#ifdef ESP_PLATFORM
+    // The decoder tables are hit on every symbol, so try to keep them out of PSRAM; the window can live there
+    auto *inf = (tinfl_decompressor *)heap_caps_malloc_prefer(sizeof(tinfl_decompressor), 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_SPIRAM);
+    dict = (uint8_t *)heap_caps_malloc(_dict_size, MALLOC_CAP_SPIRAM);
+    state = inf;
+    if (inf == nullptr || dict == nullptr) {
+        end();
+        return false;
+    }
+
+    tinfl_init(inf);
+#else
+    int window_bits = 0;
+    while (((size_t)1 << window_bits) < _dict_size) {
+        window_bits += 1;
+    }
+
+    auto *zs = (z_stream *)calloc(1, sizeof(z_stream));
+    dict = (uint8_t *)malloc(_dict_size);
+    state = zs;
+    if (zs == nullptr || dict == nullptr || window_bits < 8 || window_bits > 15 || inflateInit2(zs, -window_bits) != Z_OK) {
+        free(zs);
+        state = nullptr;
+        end();
+        return false;
+    }
+#endif
+
+    dict_size = _dict_size;
+    dict_ofs = 0;
+    done = false;
+    return true;
+}
+
+void tcfg_inflate::end()
+{
+#ifdef ESP_PLATFORM
+    heap_caps_free(state);
+    heap_caps_free(dict);
+#else
+    if (state != nullptr) {
+        inflateEnd((z_stream *)state);
+    }
+
+    free(state);
+    free(dict);
+#endif
+
+    state = nullptr;
+    dict = nullptr;
+    dict_size = 0;
+    dict_ofs = 0;
+    done = false;
+}
+
+bool tcfg_inflate::active() const
+{
+    return state != nullptr;
+}
+
+bool tcfg_inflate::finished() const
+{
+    return done;
+}
+
+tcfg_inflate::status tcfg_inflate::feed(const uint8_t *in, size_t len, tcfg_inflate::sink &out, size_t *consumed_out)
+{
+    *consumed_out = 0;
+    if (state == nullptr) {
+        return INFLATE_ERROR;
+    }
+
+    if (done) {
+        return INFLATE_DONE;
+    }
+
+#ifdef ESP_PLATFORM
+    auto *inf = (tinfl_decompressor *)state;
+    size_t in_pos = 0;
+    while (true) {
+        // dict doubles as the output buffer: tinfl writes into it as a ring, and we hand each new slice to the sink
+        size_t in_bytes = len - in_pos;
+        size_t out_bytes = dict_size - dict_ofs;
+        auto ret = tinfl_decompress(inf, in + in_pos, &in_bytes, dict, dict + dict_ofs, &out_bytes, TINFL_FLAG_HAS_MORE_INPUT);
+        in_pos += in_bytes;
+        *consumed_out = in_pos;
+
+        if (out_bytes > 0 && !out.write_out(dict + dict_ofs, out_bytes)) {
+            return INFLATE_ERROR;
+        }
+
+        dict_ofs = (dict_ofs + out_bytes) & (dict_size - 1);
+        if (ret == TINFL_STATUS_DONE) {
+            done = true;
+            return INFLATE_DONE;
+        }
+
+        if (ret < 0) {
+            return INFLATE_ERROR;
+        }
+
+        if (ret == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            return INFLATE_NEED_MORE;
+        }
+    }
+#else
+    auto *zs = (z_stream *)state;
+    zs->next_in = (Bytef *)in;
+    zs->avail_in = len;
+    while (true) {
+        zs->next_out = dict;
+        zs->avail_out = dict_size;
+        int ret = inflate(zs, Z_NO_FLUSH);
+        size_t out_bytes = dict_size - zs->avail_out;
+        *consumed_out = len - zs->avail_in;
+
+        if (out_bytes > 0 && !out.write_out(dict, out_bytes)) {
+            return INFLATE_ERROR;
+        }
+
+        if (ret == Z_STREAM_END) {
+            done = true;
+            return INFLATE_DONE;
+        }
+
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return INFLATE_ERROR;
+        }
+
+        if (zs->avail_in == 0 && zs->avail_out > 0) {
+            return INFLATE_NEED_MORE;
+        }
+    }
+#endif
+}
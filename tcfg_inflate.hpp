@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Streaming raw deflate (RFC 1951) decoder with a fixed-size window. Uses the ROM tinfl on the chip, zlib on the host.
+class tcfg_inflate
+{
+public:
+    enum status : uint8_t {
+        INFLATE_NEED_MORE = 0, // Input used up, stream not finished yet
+        INFLATE_DONE = 1, // Final block decoded; anything after it was left unconsumed
+        INFLATE_ERROR = 2, // Corrupt stream, window too small for it, or the sink refused the output
+    };
+
+    class sink
+    {
+    public:
+        virtual ~sink() = default;
+        virtual bool write_out(const uint8_t *buf, size_t len) = 0;
+    };
+
+public:
+    tcfg_inflate() = default;
+    ~tcfg_inflate();
+    tcfg_inflate(tcfg_inflate const &) = delete;
+    void operator=(tcfg_inflate const &) = delete;
+
+    // dict_size must be a power of two, and at least the window the stream was compressed with
+    bool begin(size_t dict_size);
+    void end();
+    bool active() const;
+    bool finished() const;
+
+    status feed(const uint8_t *in, size_t len, sink &out, size_t *consumed_out);
+
+private:
+    void *state = nullptr; // tinfl_decompressor or z_stream
+    uint8_t *dict = nullptr;
+    size_t dict_size = 0;
+    size_t dict_ofs = 0;
+    bool done = false;
+};
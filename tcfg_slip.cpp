@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cstring>
+#include "tcfg_slip.hpp"
+
+#ifdef ESP_PLATFORM
+#include <esp_crc.h>
+#endif
+
+namespace
+{
+    using word_t = uintptr_t;
+    constexpr word_t WORD_ONES = ~(word_t)0 / 0xff; // 0x0101...01
+    constexpr word_t WORD_HIGHS = WORD_ONES * 0x80; // 0x8080...80
+
+    // Non-zero when any byte of word equals b; the lowest flagged byte is always a real match
+    inline word_t word_has_byte(word_t word, uint8_t b)
+    {
+        word_t v = word ^ (WORD_ONES * b);
+        return (v - WORD_ONES) & ~v & WORD_HIGHS;
+    }
+
+    // CRC16/XMODEM tables for slicing by 8: val[k][b] is the CRC of byte b followed by k zero bytes. The chip only
+    // needs val[0], for single unescaped bytes; runs go through the ROM esp_crc16_be.
+#ifdef ESP_PLATFORM
+    constexpr size_t CRC16_SLICES = 1;
+#else
+    constexpr size_t CRC16_SLICES = 8;
+#endif
+
+    struct crc16_table {
+        uint16_t val[CRC16_SLICES][256] = {};
+
+        constexpr crc16_table()
+        {
+            for (uint32_t idx = 0; idx < 256; idx += 1) {
+                uint16_t crc = idx << 8;
+                for (int bit = 0; bit < 8; bit += 1) {
+                    crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+                }
+                val[0][idx] = crc;
+            }
+
+            for (size_t slice = 1; slice < CRC16_SLICES; slice += 1) {
+                for (uint32_t idx = 0; idx < 256; idx += 1) {
+                    uint16_t prev = val[slice - 1][idx];
+                    val[slice][idx] = (uint16_t)(prev << 8) ^ val[0][prev >> 8];
+                }
+            }
+        }
+    };
+
+    constexpr crc16_table CRC16_TABLE;
+
+    // Byte an escape sequence stands for; anything unexpected after SLIP_ESC is taken as-is
+    struct unescape_table {
+        uint8_t val[256] = {};
+
+        constexpr unescape_table()
+        {
+            for (uint32_t idx = 0; idx < 256; idx += 1) {
+                val[idx] = idx;
+            }
+
+            val[tcfg_slip::SLIP_ESC_END] = tcfg_slip::SLIP_END;
+            val[tcfg_slip::SLIP_ESC_ESC] = tcfg_slip::SLIP_ESC;
+            val[tcfg_slip::SLIP_ESC_START] = tcfg_slip::SLIP_START;
+        }
+    };
+
+    constexpr unescape_table UNESCAPE_TABLE;
+
+    inline uint16_t crc16_byte(uint16_t crc, uint8_t b)
+    {
+        return (uint16_t)(crc << 8) ^ CRC16_TABLE.val[0][((crc >> 8) ^ b) & 0xff];
+    }
+}
+
+uint16_t tcfg_slip::crc16_update(uint16_t crc, const uint8_t *buf, size_t len)
+{
+#ifdef ESP_PLATFORM
+    return ~esp_crc16_be((uint16_t)~crc, buf, len);
+#else
+    const auto &tbl = CRC16_TABLE.val;
+    size_t idx = 0;
+    for (; idx + 8 <= len; idx += 8) {
+        const uint8_t *in = buf + idx;
+        crc = tbl[7][(crc >> 8) ^ in[0]] ^ tbl[6][(crc & 0xff) ^ in[1]] ^ tbl[5][in[2]] ^ tbl[4][in[3]] ^
+              tbl[3][in[4]] ^ tbl[2][in[5]] ^ tbl[1][in[6]] ^ tbl[0][in[7]];
+    }
+
+    for (; idx < len; idx += 1) {
+        crc = crc16_byte(crc, buf[idx]);
+    }
+
+    return crc;
+#endif
+}
+
+void tcfg_slip::attach(tcfg_slip::decoder &dec, uint8_t *buf, size_t cap)
+{
+    dec.buf = buf;
+    dec.cap = cap;
+    restart(dec);
+}
+
+void tcfg_slip::detach(tcfg_slip::decoder &dec)
+{
+    dec.buf = nullptr;
+    dec.cap = 0;
+    restart(dec);
+}
+
+void tcfg_slip::restart(tcfg_slip::decoder &dec)
+{
+    dec.idx = 0;
+    dec.crc = 0;
+    dec.esc = false;
+    dec.discard = false;
+}
+
+void tcfg_slip::append(tcfg_slip::decoder &dec, const uint8_t *src, size_t len)
+{
+    if (len > dec.cap - dec.idx) {
+        // Too long for the buffer - drop it, the buffer gets reused by the next frame
+        dec.idx = 0;
+        dec.esc = false;
+        dec.discard = true;
+        return;
+    }
+
+    memcpy(dec.buf + dec.idx, src, len);
+    update_crc(dec, dec.idx, src, len);
+    dec.idx += len;
+}
+
+void tcfg_slip::update_crc(tcfg_slip::decoder &dec, size_t pos, const uint8_t *src, size_t len)
+{
+    while (len > 0 && pos < FRAME_CRC_OFFSET + FRAME_CRC_LEN) {
+        dec.crc = crc16_byte(dec.crc, pos < FRAME_CRC_OFFSET ? *src : 0);
+        pos += 1;
+        src += 1;
+        len -= 1;
+    }
+
+    if (len == 1) {
+        dec.crc = crc16_byte(dec.crc, *src);
+    } else if (len > 0) {
+        dec.crc = crc16_update(dec.crc, src, len);
+    }
+}
+
+bool tcfg_slip::unescape(tcfg_slip::decoder &dec, uint8_t next_byte)
+{
+    if (next_byte == SLIP_START || next_byte == SLIP_END) {
+        return false;
+    }
+
+    // A table rather than a switch: in mixed escape runs the three cases would be a coin toss for the branch predictor
+    next_byte = UNESCAPE_TABLE.val[next_byte];
+
+    // The caller folds unescaped bytes into the CRC, a run at a time
+    if (dec.idx >= dec.cap) {
+        append(dec, &next_byte, 1); // Let append() handle the overflow
+    } else {
+        dec.buf[dec.idx++] = next_byte;
+    }
+
+    return true;
+}
+
+size_t tcfg_slip::find_special(const uint8_t *buf, size_t len)
+{
+    size_t idx = 0;
+    while (idx < len && ((uintptr_t)(buf + idx) % sizeof(word_t)) != 0) {
+        if (is_special(buf[idx])) {
+            return idx;
+        }
+
+        idx += 1;
+    }
+
+    for (; idx + sizeof(word_t) <= len; idx += sizeof(word_t)) {
+        word_t word = 0;
+        memcpy(&word, buf + idx, sizeof(word));
+        if ((word_has_byte(word, SLIP_START) | word_has_byte(word, SLIP_END) | word_has_byte(word, SLIP_ESC)) != 0) {
+            break;
+        }
+    }
+
+    for (; idx < len; idx += 1) {
+        if (is_special(buf[idx])) {
+            return idx;
+        }
+    }
+
+    return len;
+}
+
+size_t tcfg_slip::encode(const uint8_t *in, size_t len, uint8_t *out, size_t out_cap, size_t *consumed_out)
+{
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    while (in_pos < len && out_pos < out_cap) {
+        if (!is_special(in[in_pos])) {
+            size_t run_len = find_special(in + in_pos, std::min(len - in_pos, out_cap - out_pos));
+            memcpy(out + out_pos, in + in_pos, run_len);
+            in_pos += run_len;
+            out_pos += run_len;
+            continue;
+        }
+
+        if (out_cap - out_pos < 2) {
+            break;
+        }
+
+        out[out_pos++] = SLIP_ESC;
+        switch (in[in_pos++]) {
+            case SLIP_START: {
+                out[out_pos++] = SLIP_ESC_START;
+                break;
+            }
+
+            case SLIP_END: {
+                out[out_pos++] = SLIP_ESC_END;
+                break;
+            }
+
+            default: { // SLIP_ESC
+                out[out_pos++] = SLIP_ESC_ESC;
+                break;
+            }
+        }
+    }
+
+    if (consumed_out != nullptr) {
+        *consumed_out = in_pos;
+    }
+
+    return out_pos;
+}
+
+size_t tcfg_slip::decode(tcfg_slip::decoder &dec, const uint8_t *in, size_t len, tcfg_slip::decode_evt *evt_out)
+{
+    *evt_out = DECODE_NEED_MORE;
+    if (in == nullptr) {
+        return 0;
+    }
+
+    size_t pos = 0;
+    while (pos < len) {
+        if (dec.buf == nullptr || dec.discard) {
+            // Nothing outside a frame matters except the next start byte
+            auto *start = (const uint8_t *)memchr(in + pos, SLIP_START, len - pos);
+            if (start == nullptr) {
+                return len;
+            }
+
+            pos = start - in + 1;
+            if (dec.buf == nullptr) {
+                *evt_out = DECODE_FRAME_START;
+                return pos;
+            }
+
+            restart(dec);
+            continue;
+        }
+
+        if (dec.esc) {
+            dec.esc = false;
+            size_t from = dec.idx;
+            if (!unescape(dec, in[pos])) {
+                continue; // Framing bytes are never escaped, let the main path handle them
+            }
+
+            if (!dec.discard) {
+                update_crc(dec, from, dec.buf + from, 1);
+            }
+
+            pos += 1;
+            continue;
+        }
+
+        if (!is_special(in[pos])) {
+            size_t run_len = find_special(in + pos, len - pos);
+            append(dec, in + pos, run_len);
+            pos += run_len;
+            continue;
+        }
+
+        switch (in[pos++]) {
+            case SLIP_START: {
+                restart(dec);
+                break;
+            }
+
+            case SLIP_END: {
+                *evt_out = DECODE_FRAME_END;
+                return pos;
+            }
+
+            default: { // SLIP_ESC
+                // Escapes come in clusters (e.g. runs of 0xc0), stay on the byte loop while the next one follows.
+                // The unescaped run is hashed in one go afterwards, read back while it's still in cache.
+                size_t from = dec.idx;
+                while (true) {
+                    if (pos == len) {
+                        dec.esc = true; // Escaped byte is in the next block
+                        break;
+                    }
+
+                    if (!unescape(dec, in[pos])) {
+                        break;
+                    }
+
+                    pos += 1;
+                    if (pos == len || in[pos] != SLIP_ESC || dec.discard) {
+                        break;
+                    }
+
+                    pos += 1;
+                }
+
+                if (!dec.discard && dec.idx > from) {
+                    update_crc(dec, from, dec.buf + from, dec.idx - from);
+                }
+                break;
+            }
+        }
+    }
+
+    return pos;
+}
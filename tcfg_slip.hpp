@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// SLIP codec shared by the wire implementations. Kept free of ESP-IDF headers so it can be built on the host.
+class tcfg_slip
+{
+public:
+    enum slip_byte : uint8_t {
+        SLIP_START = 0x5a,
+        SLIP_END = 0xc0,
+        SLIP_ESC = 0xdb,
+        SLIP_ESC_END = 0xdc,
+        SLIP_ESC_ESC = 0xdd,
+        SLIP_ESC_START = 0xde,
+    };
+
+    enum decode_evt : uint8_t {
+        DECODE_NEED_MORE = 0, // Whole input consumed, nothing for the caller to do
+        DECODE_FRAME_START = 1, // SLIP_START seen with no buffer attached; attach one and carry on
+        DECODE_FRAME_END = 2, // SLIP_END closed the frame in the attached buffer; commit it and detach
+    };
+
+    // Frames start with tcfg_client::header, whose CRC field is counted as zero when checking the frame
+    static const constexpr size_t FRAME_CRC_OFFSET = 1;
+    static const constexpr size_t FRAME_CRC_LEN = 2;
+
+    struct decoder {
+        uint8_t *buf = nullptr;
+        size_t cap = 0;
+        size_t idx = 0;
+        uint16_t crc = 0; // CRC16/XMODEM of buf[0..idx), see FRAME_CRC_OFFSET
+        bool esc = false;
+        bool discard = false; // Frame overflowed, skip until the next SLIP_START
+    };
+
+public:
+    static void attach(decoder &dec, uint8_t *buf, size_t cap);
+    static void detach(decoder &dec);
+
+    // Decode up to len bytes, stopping early on a frame start/end event. Returns the number of bytes consumed.
+    static size_t decode(decoder &dec, const uint8_t *in, size_t len, decode_evt *evt_out);
+
+    // Escape as much of in as fits into out without splitting an escape pair. Returns the number of bytes written.
+    static size_t encode(const uint8_t *in, size_t len, uint8_t *out, size_t out_cap, size_t *consumed_out);
+
+    // CRC16/XMODEM (poly 0x1021, init 0), can be chained by passing the previous result as crc
+    static uint16_t crc16_update(uint16_t crc, const uint8_t *buf, size_t len);
+
+    // Index of the first byte that needs special treatment (START/END/ESC), or len if there is none
+    static size_t find_special(const uint8_t *buf, size_t len);
+
+private:
+    static inline bool is_special(uint8_t b)
+    {
+        return b == SLIP_START || b == SLIP_END || b == SLIP_ESC;
+    }
+
+    static void append(decoder &dec, const uint8_t *src, size_t len);
+    static bool unescape(decoder &dec, uint8_t next_byte);
+    static void update_crc(decoder &dec, size_t pos, const uint8_t *src, size_t len); // src lands at frame offset pos
+    static void restart(decoder &dec);
+};
@@ -7,7 +7,8 @@
 class tcfg_wire_if
 {
 public:
-    virtual bool begin_read(uint8_t **data_out, size_t *len_written, uint32_t wait_ticks) = 0;
+    // crc_out gets the CRC16/XMODEM of the whole frame with the header CRC field counted as zero, see tcfg_slip
+    virtual bool begin_read(uint8_t **data_out, size_t *len_written, uint16_t *crc_out, uint32_t wait_ticks) = 0;
     virtual bool finalise_read(uint8_t *ret_ptr) = 0;
     virtual bool write_response(const uint8_t *header_out, size_t header_len, const uint8_t *payload_out, size_t payload_len, uint32_t wait_ticks) = 0;
     virtual bool flush(uint32_t wait_ticks) = 0;
@@ -6,8 +6,112 @@
 #include "tusb_cdc_acm.h"
 #include <esp_mac.h>
 #include <esp_flash.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+
+char tcfg_wire_usb_cdc::sn_str[32] = { 0 };
+bool tcfg_wire_usb_cdc::driver_installed = false;
+
+esp_err_t tcfg_wire_usb_cdc::init(const char *serial_num)
+{
+    cdc_channel = (tinyusb_cdcacm_itf_t)(this - registry());
+    if (rx_rb != nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Channels all share the one USB device, only the first one in sets it up
+    esp_err_t ret = ESP_OK;
+    if (!driver_installed) {
+        ret = install_driver(serial_num);
+    }
+
+    acm_cfg.usb_dev = TINYUSB_USBDEV_0;
+    acm_cfg.cdc_port = cdc_channel;
+    acm_cfg.callback_rx = &serial_rx_cb;
+    acm_cfg.callback_rx_wanted_char = nullptr;
+    acm_cfg.callback_line_state_changed = nullptr;
+    acm_cfg.callback_line_coding_changed = nullptr;
+
+    ret = ret ?: tusb_cdc_acm_init(&acm_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "TinyUSB CDC %d init failed", cdc_channel);
+        return ret;
+    }
+
+    // Frames are decoded here then copied into rx_rb at their real length, so a ping doesn't tie up a whole MAX_PACKET_SIZE slot.
+    // PSRAM like tx_stage: the decoder fills it with memcpy() runs, and it's read back once, straight out of cache.
+    rx_stage = static_cast<uint8_t *>(heap_caps_malloc(sizeof(rx_frame_meta) + MAX_PACKET_SIZE, MALLOC_CAP_SPIRAM));
+
+    // TODO: put size in Kconfig later
+    rx_rb = xRingbufferCreateWithCaps(65536, RINGBUF_TYPE_NOSPLIT, MALLOC_CAP_SPIRAM);
+    if (rx_stage == nullptr || rx_rb == nullptr) {
+        ESP_LOGE(TAG, "Failed to create Rx ring buffer");
+        free_bufs();
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Replies are SLIP encoded into tx_stage, then queued whole for tx_task, so a slow host only ever stalls tx_task
+    tx_stage = static_cast<uint8_t *>(heap_caps_malloc(TX_STAGE_SIZE, MALLOC_CAP_SPIRAM));
+    tx_rb = xRingbufferCreateWithCaps(TX_QUEUE_SIZE, RINGBUF_TYPE_BYTEBUF, MALLOC_CAP_SPIRAM);
+    tx_lock = xSemaphoreCreateMutex();
+    tx_evt = xEventGroupCreate();
+    if (tx_stage == nullptr || tx_rb == nullptr || tx_lock == nullptr || tx_evt == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate Tx queue");
+        free_bufs();
+        return ESP_ERR_NO_MEM;
+    }
+
+    xEventGroupSetBits(tx_evt, TX_IDLE);
+    char task_name[configMAX_TASK_NAME_LEN] = {};
+    snprintf(task_name, sizeof(task_name), "tcfg_cdc_tx%d", cdc_channel);
+    if (xTaskCreateWithCaps(tx_task, task_name, 3072, this, tskIDLE_PRIORITY + 2, &tx_task_handle, MALLOC_CAP_INTERNAL) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to create Tx task");
+        free_bufs();
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
 
 esp_err_t tcfg_wire_usb_cdc::init(const char *serial_num, tinyusb_cdcacm_itf_t channel)
+{
+    if (instance(channel) != this) {
+        ESP_LOGE(TAG, "Init: channel %d asked of the channel %d instance", channel, (int)(this - registry()));
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return init(serial_num);
+}
+
+void tcfg_wire_usb_cdc::free_bufs()
+{
+    heap_caps_free(rx_stage);
+    rx_stage = nullptr;
+    heap_caps_free(tx_stage);
+    tx_stage = nullptr;
+
+    if (rx_rb != nullptr) {
+        vRingbufferDeleteWithCaps(rx_rb);
+        rx_rb = nullptr;
+    }
+
+    if (tx_rb != nullptr) {
+        vRingbufferDeleteWithCaps(tx_rb);
+        tx_rb = nullptr;
+    }
+
+    if (tx_lock != nullptr) {
+        vSemaphoreDelete(tx_lock);
+        tx_lock = nullptr;
+    }
+
+    if (tx_evt != nullptr) {
+        vEventGroupDelete(tx_evt);
+        tx_evt = nullptr;
+    }
+}
+
+esp_err_t tcfg_wire_usb_cdc::install_driver(const char *serial_num)
 {
     if (serial_num == nullptr) {
         uint8_t sn_buf[16] = { 0 };
@@ -17,10 +121,9 @@ esp_err_t tcfg_wire_usb_cdc::init(const char *serial_num, tinyusb_cdcacm_itf_t c
                  sn_buf[0], sn_buf[1], sn_buf[2], sn_buf[3], sn_buf[4], sn_buf[5], sn_buf[6], sn_buf[7],
                  sn_buf[8], sn_buf[9], sn_buf[10], sn_buf[11], sn_buf[12], sn_buf[13]);
     } else {
-        strncpy(sn_str, serial_num, sizeof(sn_str));
+        snprintf(sn_str, sizeof(sn_str), "%s", serial_num);
     }
 
-    cdc_channel = channel;
     static char lang[2] = {0x09, 0x04};
     static const char *desc_str[5] = {
             lang,                // 0: is supported language is English (0x0409)
@@ -38,44 +141,37 @@ esp_err_t tcfg_wire_usb_cdc::init(const char *serial_num, tinyusb_cdcacm_itf_t c
     tusb_cfg.string_descriptor_count = sizeof(desc_str) / sizeof(desc_str[0]);
 
     auto ret = tinyusb_driver_install(&tusb_cfg);
-
-
-    acm_cfg.usb_dev = TINYUSB_USBDEV_0;
-    acm_cfg.cdc_port = channel;
-    acm_cfg.callback_rx = &serial_rx_cb;
-    acm_cfg.callback_rx_wanted_char = nullptr;
-    acm_cfg.callback_line_state_changed = nullptr;
-    acm_cfg.callback_line_coding_changed = nullptr;
-
-    ret = ret ?: tusb_cdc_acm_init(&acm_cfg);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "TinyUSB driver install failed");
         return ret;
     }
 
-    // TODO: put size in Kconfig later
-    rx_rb = xRingbufferCreateWithCaps(65536, RINGBUF_TYPE_NOSPLIT, MALLOC_CAP_SPIRAM);
-    if (rx_rb == nullptr) {
-        ESP_LOGE(TAG, "Failed to create Rx ring buffer");
-        return ESP_ERR_NO_MEM;
-    }
-
+    driver_installed = true;
     return ESP_OK;
 }
 
 
-bool tcfg_wire_usb_cdc::begin_read(uint8_t **data_out, size_t *len_written, uint32_t wait_ticks)
+bool tcfg_wire_usb_cdc::begin_read(uint8_t **data_out, size_t *len_written, uint16_t *crc_out, uint32_t wait_ticks)
 {
     if (data_out == nullptr) {
         return false;
     }
 
-    auto *ptr = (uint8_t *)xRingbufferReceive(rx_rb, len_written, wait_ticks);
-    if (ptr == nullptr) {
+    size_t item_len = 0;
+    auto *meta = (rx_frame_meta *)xRingbufferReceive(rx_rb, &item_len, wait_ticks);
+    if (meta == nullptr) {
         return false;
     }
 
-    *data_out = ptr;
+    *data_out = (uint8_t *)meta + sizeof(rx_frame_meta);
+    if (len_written != nullptr) {
+        *len_written = meta->len;
+    }
+
+    if (crc_out != nullptr) {
+        *crc_out = meta->crc;
+    }
+
     return true;
 }
 
@@ -85,83 +181,119 @@ bool tcfg_wire_usb_cdc::finalise_read(uint8_t *ret_ptr)
         return false;
     }
 
-    vRingbufferReturnItem(rx_rb, ret_ptr);
+    vRingbufferReturnItem(rx_rb, ret_ptr - sizeof(rx_frame_meta));
     return true;
 }
 
 bool tcfg_wire_usb_cdc::write_response(const uint8_t *header_out, size_t header_len, const uint8_t *payload_out, size_t payload_len, uint32_t wait_ticks)
 {
-    const uint8_t slip_esc_end[] = { SLIP_ESC, SLIP_ESC_END };
-    const uint8_t slip_esc_esc[] = { SLIP_ESC, SLIP_ESC_ESC };
-    const uint8_t slip_esc_start[] = { SLIP_ESC, SLIP_ESC_START };
-
     if (header_out == nullptr || header_len < 1) {
         ESP_LOGW(TAG, "Write: header is null! Skip write");
         return false;
     }
 
-    const uint8_t slip_start = SLIP_START;
-    tinyusb_cdcacm_write_queue(cdc_channel, &slip_start, 1);
+    if (payload_out == nullptr) {
+        payload_len = 0;
+    }
 
-    for (size_t idx = 0; idx < header_len; idx += 1) {
-        switch (header_out[idx]) {
-            case SLIP_START: {
-                tinyusb_cdcacm_write_queue(cdc_channel, slip_esc_start, sizeof(slip_esc_start));
-                break;
-            }
+    if (tx_rb == nullptr || header_len + payload_len > MAX_PACKET_SIZE) {
+        ESP_LOGE(TAG, "Write: frame too large or wire not ready, len %u", header_len + payload_len);
+        return false;
+    }
 
-            case SLIP_END: {
-                tinyusb_cdcacm_write_queue(cdc_channel, slip_esc_end, sizeof(slip_esc_end));
-                break;
-            }
+#ifdef CONFIG_TC_TX_DROP_WHEN_FULL
+    wait_ticks = std::min<uint32_t>(wait_ticks, pdMS_TO_TICKS(CONFIG_TC_TX_FULL_TIMEOUT_MS));
+#endif
+
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    size_t tx_idx = 0;
+    tx_stage[tx_idx++] = tcfg_slip::SLIP_START;
+    tx_idx = encode_to_stage(header_out, header_len, tx_idx);
+    tx_idx = encode_to_stage(payload_out, payload_len, tx_idx);
+    tx_stage[tx_idx++] = tcfg_slip::SLIP_END;
+
+    // The whole frame goes in or none of it does, so a drop never leaves half a frame on the wire
+    bool queued = xRingbufferSend(tx_rb, tx_stage, tx_idx, wait_ticks) == pdTRUE;
+    if (queued) {
+        xEventGroupClearBits(tx_evt, TX_IDLE);
+        tx_stat.frames += 1;
+        tx_stat.high_water = std::max<uint32_t>(tx_stat.high_water, TX_QUEUE_SIZE - xRingbufferGetCurFreeSize(tx_rb));
+    } else {
+        tx_stat.dropped += 1;
+        ESP_LOGW(TAG, "Write: Tx queue full, dropped %u byte frame", tx_idx);
+    }
 
-            case SLIP_ESC: {
-                tinyusb_cdcacm_write_queue(cdc_channel, slip_esc_esc, sizeof(slip_esc_esc));
-                break;
-            }
+    xSemaphoreGive(tx_lock);
+    return queued;
+}
 
-            default: {
-                tinyusb_cdcacm_write_queue(cdc_channel, &header_out[idx], 1);
-            }
-        }
+size_t tcfg_wire_usb_cdc::encode_to_stage(const uint8_t *buf, size_t len, size_t tx_idx)
+{
+    if (buf == nullptr || len == 0) {
+        return tx_idx;
     }
 
-    const uint8_t slip_end = SLIP_END;
-    if (payload_out == nullptr || payload_len == 0) {
-        tinyusb_cdcacm_write_queue(cdc_channel, &slip_end, 1);
-        ESP_LOGD(TAG, "Write: no more payload, ending");
-        return tinyusb_cdcacm_write_flush(cdc_channel, wait_ticks) == ESP_OK;
-    }
+    // tx_stage is sized for the worst case, so this always takes the whole buffer
+    size_t consumed = 0;
+    return tx_idx + tcfg_slip::encode(buf, len, tx_stage + tx_idx, TX_STAGE_SIZE - tx_idx, &consumed);
+}
 
-    for (size_t idx = 0; idx < payload_len; idx += 1) {
-        switch (payload_out[idx]) {
-            case SLIP_START: {
-                tinyusb_cdcacm_write_queue(cdc_channel, slip_esc_start, sizeof(slip_esc_start));
-                break;
-            }
+void tcfg_wire_usb_cdc::tx_task(void *_ctx)
+{
+    auto *ctx = static_cast<tcfg_wire_usb_cdc *>(_ctx);
+    while (true) {
+        size_t len = 0;
+        auto *buf = static_cast<uint8_t *>(xRingbufferReceiveUpTo(ctx->tx_rb, &len, portMAX_DELAY, TX_BLOCK_SIZE));
+        if (buf == nullptr) {
+            continue;
+        }
 
-            case SLIP_END: {
-                tinyusb_cdcacm_write_queue(cdc_channel, slip_esc_end, sizeof(slip_esc_end));
-                break;
-            }
+        if (!ctx->queue_tx(buf, len, portMAX_DELAY)) {
+            ESP_LOGW(TAG, "Tx: host not reading, %u bytes lost", len);
+            vTaskDelay(1);
+        }
 
-            case SLIP_ESC: {
-                tinyusb_cdcacm_write_queue(cdc_channel, slip_esc_esc, sizeof(slip_esc_esc));
-                break;
-            }
+        vRingbufferReturnItem(ctx->tx_rb, buf);
 
-            default: {
-                tinyusb_cdcacm_write_queue(cdc_channel, &payload_out[idx], 1);
+        // Push out the partial FIFO once we've caught up, otherwise keep filling it
+        if (xRingbufferGetCurFreeSize(ctx->tx_rb) == TX_QUEUE_SIZE) {
+            tinyusb_cdcacm_write_flush(ctx->cdc_channel, 0);
+
+            // Checked again under tx_lock, a frame queued since then keeps flush() waiting
+            xSemaphoreTake(ctx->tx_lock, portMAX_DELAY);
+            if (xRingbufferGetCurFreeSize(ctx->tx_rb) == TX_QUEUE_SIZE) {
+                xEventGroupSetBits(ctx->tx_evt, TX_IDLE);
             }
+
+            xSemaphoreGive(ctx->tx_lock);
         }
     }
+}
 
-    tinyusb_cdcacm_write_queue(cdc_channel, &slip_end, 1);
-    return tinyusb_cdcacm_write_flush(cdc_channel, wait_ticks) == ESP_OK;
+bool tcfg_wire_usb_cdc::queue_tx(const uint8_t *buf, size_t len, uint32_t wait_ticks)
+{
+    size_t queued = 0;
+    while (queued < len) {
+        size_t ret_len = tinyusb_cdcacm_write_queue(cdc_channel, buf + queued, len - queued);
+        queued += ret_len;
+
+        // TinyUSB FIFO full - flush it out and try again
+        if (queued < len && tinyusb_cdcacm_write_flush(cdc_channel, wait_ticks) != ESP_OK && ret_len == 0) {
+            ESP_LOGE(TAG, "Write: FIFO stalled, %u of %u queued", queued, len);
+            return false;
+        }
+    }
+
+    return true;
 }
 
 bool tcfg_wire_usb_cdc::flush(uint32_t wait_ticks)
 {
+    // Wait for tx_task to drain what's already queued, then for TinyUSB to send it
+    if (tx_evt != nullptr && (xEventGroupWaitBits(tx_evt, TX_IDLE, pdFALSE, pdTRUE, wait_ticks) & TX_IDLE) == 0) {
+        return false;
+    }
+
     return tinyusb_cdcacm_write_flush(cdc_channel, wait_ticks) == ESP_OK;
 }
 
@@ -186,118 +318,65 @@ bool tcfg_wire_usb_cdc::resume()
 
 void tcfg_wire_usb_cdc::serial_rx_cb(int itf, cdcacm_event_t *event)
 {
-    auto *ctx = tcfg_wire_usb_cdc::instance();
-    if (itf != ctx->cdc_channel || event == nullptr) {
+    auto *ctx = tcfg_wire_usb_cdc::instance(static_cast<tinyusb_cdcacm_itf_t>(itf));
+    if (ctx == nullptr || ctx->rx_rb == nullptr || event == nullptr) {
         return;
     }
 
     if (event->type == CDC_EVENT_RX) {
         size_t rx_len_out = 0;
-        esp_err_t ret = ESP_OK;
         do {
-            uint8_t next_byte = 0;
-            ret = tinyusb_cdcacm_read(static_cast<tinyusb_cdcacm_itf_t>(itf), &next_byte, 1, &rx_len_out);
-            if (rx_len_out == 0) {
-                continue;
-            }
-
-            ESP_LOGD(TAG, "Recv: 0x%02x", next_byte);
+            auto ret = tinyusb_cdcacm_read(static_cast<tinyusb_cdcacm_itf_t>(itf), ctx->rx_block, sizeof(ctx->rx_block), &rx_len_out);
             if (ret != ESP_OK) {
                 ESP_LOGW(TAG, "CDC read fail: %d %s", ret, esp_err_to_name(ret));
                 return;
             }
 
-            switch (next_byte) {
-                case SLIP_START: {
-                    if (ctx->curr_decoded_buf == nullptr) {
-                        if (xRingbufferSendAcquire(ctx->rx_rb, (void **)&ctx->curr_decoded_buf, tcfg_wire_usb_cdc::MAX_PACKET_SIZE, pdMS_TO_TICKS(100)) != pdTRUE) {
-                            ESP_LOGE(TAG, "CDC Rx buffer full!");
-                            ctx->slip_esc = false;
-                            return;
-                        }
-                    }
+            size_t pos = 0;
+            while (pos < rx_len_out) {
+                auto evt = tcfg_slip::DECODE_NEED_MORE;
+                pos += tcfg_slip::decode(ctx->slip_decoder, ctx->rx_block + pos, rx_len_out - pos, &evt);
 
-                    ctx->decode_idx = 0;
-                    ctx->slip_esc = false;
-                    break;
-                }
-
-                case SLIP_END: {
-                    if (ctx->curr_decoded_buf != nullptr) {
-                        xRingbufferSendComplete(ctx->rx_rb, ctx->curr_decoded_buf);
-                        ctx->curr_decoded_buf = nullptr;
-                        ctx->decode_idx = 0;
+                switch (evt) {
+                    case tcfg_slip::DECODE_FRAME_START: {
+                        tcfg_slip::attach(ctx->slip_decoder, ctx->rx_stage + sizeof(rx_frame_meta), tcfg_wire_usb_cdc::MAX_PACKET_SIZE);
+                        break;
                     }
 
-                    ctx->slip_esc = false;
-                    break;
-                }
-
-                case SLIP_ESC: {
-                    if (ctx->curr_decoded_buf == nullptr) {
-                        continue;
-                    }
-
-                    ctx->slip_esc = true;
-                    break;
-                }
-
-                case SLIP_ESC_END: {
-                    if (ctx->curr_decoded_buf == nullptr) {
-                        continue;
-                    }
-                    if (ctx->slip_esc) {
-                        ctx->curr_decoded_buf[ctx->decode_idx++] = SLIP_END;
-                        ctx->slip_esc = false;
-                    } else {
-                        ctx->curr_decoded_buf[ctx->decode_idx++] = SLIP_ESC_END;
-                    }
-
-                    break;
-                }
-
-                case SLIP_ESC_ESC: {
-                    if (ctx->curr_decoded_buf == nullptr) {
-                        continue;
-                    }
-
-                    if (ctx->slip_esc) {
-                        ctx->curr_decoded_buf[ctx->decode_idx++] = SLIP_ESC;
-                        ctx->slip_esc = false;
-                    } else {
-                        ctx->curr_decoded_buf[ctx->decode_idx++] = SLIP_ESC_ESC;
-                    }
-
-                    break;
-                }
-
-                case SLIP_ESC_START: {
-                    if (ctx->curr_decoded_buf == nullptr) {
-                        continue;
-                    }
+                    case tcfg_slip::DECODE_FRAME_END: {
+                        ESP_LOGD(TAG, "Recv: frame len %u crc 0x%04x", ctx->slip_decoder.idx, ctx->slip_decoder.crc);
+                        auto *meta = reinterpret_cast<rx_frame_meta *>(ctx->rx_stage);
+                        meta->len = ctx->slip_decoder.idx;
+                        meta->crc = ctx->slip_decoder.crc;
+                        meta->reserved = 0;
+                        if (xRingbufferSend(ctx->rx_rb, ctx->rx_stage, sizeof(rx_frame_meta) + meta->len, pdMS_TO_TICKS(100)) != pdTRUE) {
+                            ESP_LOGE(TAG, "CDC Rx buffer full! Dropped %u byte frame", meta->len);
+                        }
 
-                    if (ctx->slip_esc) {
-                        ctx->curr_decoded_buf[ctx->decode_idx++] = SLIP_START;
-                        ctx->slip_esc = false;
-                    } else {
-                        ctx->curr_decoded_buf[ctx->decode_idx++] = SLIP_ESC_START;
+                        tcfg_slip::detach(ctx->slip_decoder);
+                        break;
                     }
 
-                    break;
-                }
-
-                default: {
-                    if (ctx->curr_decoded_buf == nullptr) {
-                        ESP_LOGD(TAG, "Not started but recv'ing: 0x%02x", next_byte);
-                        continue;
+                    default: {
+                        break;
                     }
-
-                    ctx->curr_decoded_buf[ctx->decode_idx++] = next_byte;
-                    break;
                 }
             }
-        } while (rx_len_out != 0);
+        } while (rx_len_out == sizeof(ctx->rx_block));
+    }
+}
+
+tcfg_wire_usb_cdc::tx_stats tcfg_wire_usb_cdc::get_tx_stats() const
+{
+    if (tx_lock == nullptr) {
+        return {};
     }
+
+    xSemaphoreTake(tx_lock, portMAX_DELAY);
+    auto stats = tx_stat;
+    stats.queued_bytes = TX_QUEUE_SIZE - xRingbufferGetCurFreeSize(tx_rb);
+    xSemaphoreGive(tx_lock);
+    return stats;
 }
 
 size_t tcfg_wire_usb_cdc::max_packet_size()
@@ -2,36 +2,42 @@
 
 #include <esp_err.h>
 #include "tcfg_wire_interface.hpp"
+#include "tcfg_slip.hpp"
 #include <tinyusb.h>
 #include <tusb_cdc_acm.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/ringbuf.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
 
 class tcfg_wire_usb_cdc : public tcfg_wire_if
 {
 public:
-    static tcfg_wire_usb_cdc *instance()
+    // One per CDC-ACM channel, each with its own Rx ring buffer and SLIP state
+    static tcfg_wire_usb_cdc *instance(tinyusb_cdcacm_itf_t channel = TINYUSB_CDC_ACM_0)
     {
-        static tcfg_wire_usb_cdc _instance;
-        return &_instance;
+        return channel < TINYUSB_CDC_ACM_MAX ? &registry()[channel] : nullptr;
     }
 
     tcfg_wire_usb_cdc(tcfg_wire_usb_cdc const &) = delete;
     void operator=(tcfg_wire_usb_cdc const &) = delete;
 
 public:
-    enum slip_byte : uint8_t {
-        SLIP_START = 0x5a,
-        SLIP_END = 0xc0,
-        SLIP_ESC = 0xdb,
-        SLIP_ESC_END = 0xdc,
-        SLIP_ESC_ESC = 0xdd,
-        SLIP_ESC_START = 0xde,
+    // Counters are kept under tx_lock, get_tx_stats() takes a consistent copy
+    struct tx_stats {
+        uint32_t queued_bytes; // Encoded bytes waiting for the Tx task right now
+        uint32_t high_water;   // Most ever waiting at once
+        uint32_t frames;
+        uint32_t dropped;      // Frames that didn't fit in the queue in time
     };
 
 public:
-    esp_err_t init(const char *serial_num = nullptr, tinyusb_cdcacm_itf_t channel = TINYUSB_CDC_ACM_0);
-    bool begin_read(uint8_t **data_out, size_t *len_written, uint32_t wait_ticks) override;
+    // The first channel to init installs the TinyUSB driver, so its serial number is the one the device reports
+    esp_err_t init(const char *serial_num = nullptr);
+    // Kept for callers from before channels had their own instances; `channel` must be this instance's own
+    esp_err_t init(const char *serial_num, tinyusb_cdcacm_itf_t channel);
+    bool begin_read(uint8_t **data_out, size_t *len_written, uint16_t *crc_out, uint32_t wait_ticks) override;
     bool finalise_read(uint8_t *ret_ptr) override;
     bool write_response(const uint8_t *header_out, size_t header_len, const uint8_t *payload_out, size_t payload_len, uint32_t wait_ticks) override;
     bool flush(uint32_t wait_ticks) override;
@@ -39,21 +45,54 @@ public:
     bool resume() override;
     size_t max_packet_size() override;
     bool ditch_read() override;
+    tcfg_wire_usb_cdc::tx_stats get_tx_stats() const;
+
+private:
+    // Prepended to every frame in rx_rb, each item is exactly this plus the decoded frame
+    struct rx_frame_meta {
+        uint32_t len;
+        uint16_t crc;
+        uint16_t reserved;
+    };
 
 private:
     tcfg_wire_usb_cdc() = default;
+    static tcfg_wire_usb_cdc *registry()
+    {
+        static tcfg_wire_usb_cdc _instances[TINYUSB_CDC_ACM_MAX];
+        return _instances;
+    }
+
+    static esp_err_t install_driver(const char *serial_num);
+    void free_bufs();
     static void serial_rx_cb(int itf, cdcacm_event_t *event);
+    static void tx_task(void *_ctx);
+    size_t encode_to_stage(const uint8_t *buf, size_t len, size_t tx_idx);
+    bool queue_tx(const uint8_t *buf, size_t len, uint32_t wait_ticks);
 
 private:
     static const constexpr size_t MAX_PACKET_SIZE = 8192;
+    static const constexpr size_t RX_BLOCK_SIZE = CONFIG_TINYUSB_CDC_RX_BUFSIZE;
+    static const constexpr size_t TX_BLOCK_SIZE = CONFIG_TINYUSB_CDC_TX_BUFSIZE;
+    static const constexpr size_t TX_STAGE_SIZE = MAX_PACKET_SIZE * 2 + 2; // Every byte escaped, plus the delimiters
+    static const constexpr size_t TX_QUEUE_SIZE = CONFIG_TC_TX_QUEUE_SIZE;
+    static_assert(TX_QUEUE_SIZE >= TX_STAGE_SIZE, "Tx queue must fit a worst case frame");
+    static const constexpr EventBits_t TX_IDLE = BIT(0);
     static const constexpr char TAG[] = "tcfg_usbcdc";
     bool has_force_paused = false;
     RingbufHandle_t rx_rb = nullptr;
-    bool slip_esc = false;
+    RingbufHandle_t tx_rb = nullptr;
+    SemaphoreHandle_t tx_lock = nullptr; // tx_stage, tx_stat, and queueing into tx_rb
+    EventGroupHandle_t tx_evt = nullptr; // TX_IDLE while tx_rb is empty, for flush() to wait on
+    TaskHandle_t tx_task_handle = nullptr;
+    tcfg_wire_usb_cdc::tx_stats tx_stat = {};
     tinyusb_cdcacm_itf_t cdc_channel = TINYUSB_CDC_ACM_MAX;
-    uint8_t *curr_decoded_buf = nullptr;
-    size_t decode_idx = 0;
+    tcfg_slip::decoder slip_decoder = {};
+    uint8_t *rx_stage = nullptr; // rx_frame_meta + MAX_PACKET_SIZE, the frame being decoded
+    uint8_t rx_block[RX_BLOCK_SIZE] = { 0 };
+    uint8_t *tx_stage = nullptr;
     tinyusb_config_cdcacm_t acm_cfg = {};
-    char sn_str[32] = { 0 };
+    static char sn_str[32];
+    static bool driver_installed;
 };
 